@@ -0,0 +1,57 @@
+#ifndef BACKGROUND_WORKER_H
+#define BACKGROUND_WORKER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace vm {
+
+// Runs a unit of work on its own thread whenever wake() is called and at
+// least once per poll_interval; the work function returns how many items
+// (pages reclaimed, ranges collapsed) it handled.
+class BackgroundWorker {
+public:
+    using WorkFn = std::function<size_t()>;
+
+    explicit BackgroundWorker(WorkFn work,
+                              std::chrono::milliseconds poll_interval = std::chrono::milliseconds(10));
+    ~BackgroundWorker();
+
+    BackgroundWorker(const BackgroundWorker&) = delete;
+    BackgroundWorker& operator=(const BackgroundWorker&) = delete;
+
+    void start();
+    void stop();
+    void wake();
+
+    bool is_running() const { return running_; }
+    size_t get_wakeups() const { return wakeups_; }
+    size_t get_runs() const { return runs_; }
+    size_t get_items_processed() const { return items_processed_; }
+
+private:
+    WorkFn work_;
+    std::chrono::milliseconds poll_interval_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool running_;
+    bool stop_requested_;
+    bool wake_pending_;
+
+    std::atomic<size_t> wakeups_;
+    std::atomic<size_t> runs_;
+    std::atomic<size_t> items_processed_;
+
+    void run();
+};
+
+} // namespace vm
+
+#endif // BACKGROUND_WORKER_H
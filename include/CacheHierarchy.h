@@ -0,0 +1,96 @@
+#ifndef CACHE_HIERARCHY_H
+#define CACHE_HIERARCHY_H
+
+#include "Config.h"
+#include "Metrics.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+struct CacheLevelConfig {
+    std::string name;
+    size_t size_bytes;
+    size_t line_size;
+    size_t associativity;
+    size_t hit_cycles;
+    CacheReplacement replacement;
+};
+
+class Cache {
+public:
+    explicit Cache(const CacheLevelConfig& config, std::shared_ptr<MetricsRegistry> metrics = nullptr);
+
+    bool lookup(uint64_t line, bool write);
+    std::optional<uint64_t> fill(uint64_t line, bool dirty);
+    std::optional<uint64_t> absorb_writeback(uint64_t line);
+    void invalidate_all();
+
+    const std::string& get_name() const { return config_.name; }
+    size_t get_num_sets() const { return num_sets_; }
+    size_t get_associativity() const { return ways_; }
+    size_t get_hit_cycles() const { return config_.hit_cycles; }
+    size_t get_accesses() const { return accesses_.value(); }
+    size_t get_misses() const { return misses_.value(); }
+    size_t get_writebacks() const { return writebacks_.value(); }
+    double get_miss_rate() const {
+        size_t accesses = get_accesses();
+        return accesses > 0 ? static_cast<double>(get_misses()) / accesses : 0.0;
+    }
+
+private:
+    static constexpr uint8_t kValid = 1 << 0;
+    static constexpr uint8_t kDirty = 1 << 1;
+    static constexpr uint8_t kMaxRrpv = 3;
+
+    CacheLevelConfig config_;
+    size_t num_sets_;
+    size_t ways_;
+    uint64_t clock_;
+    uint64_t rng_state_;
+
+    std::vector<uint64_t> tags_;
+    std::vector<uint8_t> flags_;
+    std::vector<uint64_t> ages_;
+
+    std::shared_ptr<MetricsRegistry> metrics_;
+    Counter accesses_;
+    Counter misses_;
+    Counter writebacks_;
+
+    size_t select_victim(size_t base);
+};
+
+class CacheHierarchy {
+public:
+    CacheHierarchy(const std::vector<CacheLevelConfig>& levels, size_t memory_cycles,
+                   std::shared_ptr<MetricsRegistry> metrics = nullptr);
+
+    static std::vector<CacheLevelConfig> levels_from_config(const Config& config);
+
+    uint64_t access(PhysicalAddress paddr, bool write);
+    void invalidate_all();
+
+    size_t get_num_levels() const { return levels_.size(); }
+    const Cache& get_level(size_t level) const { return *levels_.at(level); }
+    size_t get_memory_reads() const { return memory_reads_.value(); }
+    size_t get_memory_writes() const { return memory_writes_.value(); }
+
+private:
+    std::vector<std::unique_ptr<Cache>> levels_;
+    size_t line_shift_;
+    size_t memory_cycles_;
+
+    std::shared_ptr<MetricsRegistry> metrics_;
+    Counter memory_reads_;
+    Counter memory_writes_;
+
+    uint64_t access_level(size_t level, uint64_t line, bool write);
+    void write_back(size_t level, uint64_t line);
+};
+
+} // namespace vm
+
+#endif // CACHE_HIERARCHY_H
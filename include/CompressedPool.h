@@ -0,0 +1,97 @@
+#ifndef COMPRESSED_POOL_H
+#define COMPRESSED_POOL_H
+
+#include "Config.h"
+#include "Metrics.h"
+#include "PhysicalMemory.h"
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace vm {
+
+using CompressedHandle = uint64_t;
+
+// Compressed pages live in slabs carved out of pinned PhysicalMemory frames,
+// so every pool page is a frame taken from the resident set. capacity_bytes
+// caps how much of RAM the pool may take; once it is reached, store() asks the
+// writeback hook to push the oldest compressed page out to swap.
+class CompressedPool {
+public:
+    static constexpr size_t kMaxPagesPerSlab = 4;
+    static constexpr size_t kMaxWritebacksPerStore = 32;
+
+    CompressedPool(PhysicalMemory& memory, size_t capacity_bytes,
+                   std::shared_ptr<MetricsRegistry> metrics = nullptr);
+
+    void set_writeback(std::function<bool()> writeback) { writeback_ = std::move(writeback); }
+
+    std::optional<CompressedHandle> store(const uint8_t* page);
+    size_t load(CompressedHandle handle, uint8_t* page);
+    void release(CompressedHandle handle);
+    size_t get_compressed_size(CompressedHandle handle) const;
+
+    bool is_enabled() const { return capacity_pages_ > 0; }
+    size_t get_capacity_pages() const { return capacity_pages_; }
+    size_t get_used_pages() const { return used_pages_; }
+    size_t get_stored_pages() const { return stored_pages_; }
+    size_t get_compressed_bytes() const { return compressed_bytes_; }
+    size_t get_num_classes() const { return classes_.size(); }
+    size_t get_max_compressed_size() const { return max_compressed_size_; }
+    size_t get_writebacks() const { return writebacks_.value(); }
+    double get_compression_ratio() const;
+    double get_occupancy() const;
+
+private:
+    struct Slab {
+        std::vector<FrameNumber> frames;
+        std::vector<uint16_t> lengths;
+        std::vector<uint16_t> free_slots;
+        bool in_partial_list;
+    };
+
+    struct SizeClass {
+        size_t object_size;
+        size_t pages_per_slab;
+        size_t objects_per_slab;
+        std::vector<std::unique_ptr<Slab>> slabs;
+        std::vector<uint32_t> free_slab_ids;
+        std::vector<uint32_t> partial_slabs;
+    };
+
+    PhysicalMemory& memory_;
+    size_t page_size_;
+    size_t capacity_pages_;
+    size_t class_granularity_;
+    size_t max_compressed_size_;
+    size_t used_pages_;
+    size_t stored_pages_;
+    size_t compressed_bytes_;
+
+    std::vector<SizeClass> classes_;
+    std::vector<uint8_t> scratch_;
+    std::vector<uint8_t> gather_;
+    std::function<bool()> writeback_;
+
+    std::shared_ptr<MetricsRegistry> metrics_;
+    Counter stores_;
+    Counter loads_;
+    Counter rejected_incompressible_;
+    Counter rejected_full_;
+    Counter writebacks_;
+    Gauge stored_pages_gauge_;
+    Gauge compressed_bytes_gauge_;
+    Gauge pool_pages_gauge_;
+    Histogram compressed_size_;
+
+    Slab* slab_for(CompressedHandle handle, SizeClass*& size_class, size_t& slot) const;
+    std::optional<uint32_t> allocate_slab(SizeClass& size_class);
+    void free_slab(SizeClass& size_class, uint32_t slab_id);
+    void copy_to_slab(const Slab& slab, size_t offset, const uint8_t* src, size_t size);
+    void copy_from_slab(const Slab& slab, size_t offset, uint8_t* dst, size_t size);
+};
+
+} // namespace vm
+
+#endif // COMPRESSED_POOL_H
@@ -0,0 +1,15 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vm {
+
+size_t lz4_compress_bound(size_t input_size);
+size_t lz4_compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity);
+size_t lz4_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity);
+
+} // namespace vm
+
+#endif // COMPRESSION_H
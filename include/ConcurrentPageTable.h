@@ -0,0 +1,68 @@
+#ifndef CONCURRENT_PAGE_TABLE_H
+#define CONCURRENT_PAGE_TABLE_H
+
+#include "Config.h"
+#include "PageTable.h"
+#include <atomic>
+#include <memory>
+#include <optional>
+
+namespace vm {
+
+enum class ClaimResult {
+    Claimed,
+    AlreadyMapped
+};
+
+class ConcurrentPageTable {
+public:
+    static constexpr uint64_t kValidBit = 1ULL << 0;
+    static constexpr uint64_t kBusyBit = 1ULL << 1;
+    static constexpr uint64_t kDirtyBit = 1ULL << 2;
+    static constexpr uint64_t kReferencedBit = 1ULL << 3;
+    static constexpr unsigned kProtectionShift = 4;
+    static constexpr unsigned kFrameShift = 12;
+
+    explicit ConcurrentPageTable(const Config& config);
+    ~ConcurrentPageTable();
+
+    ConcurrentPageTable(const ConcurrentPageTable&) = delete;
+    ConcurrentPageTable& operator=(const ConcurrentPageTable&) = delete;
+
+    std::optional<PageTableEntry> lookup(PageNumber vpn) const;
+    bool mark_accessed(PageNumber vpn, bool write);
+
+    ClaimResult claim(PageNumber vpn, PageTableEntry& existing);
+    void publish(PageNumber vpn, FrameNumber pfn, uint8_t protection);
+    void abandon(PageNumber vpn);
+
+    size_t get_num_entries() const { return num_entries_.load(std::memory_order_relaxed); }
+    size_t get_num_nodes() const { return num_nodes_.load(std::memory_order_relaxed); }
+
+    static PageTableEntry decode(uint64_t word);
+    static uint64_t encode(FrameNumber pfn, uint8_t protection);
+
+private:
+    struct Node {
+        std::unique_ptr<std::atomic<Node*>[]> children;
+        std::unique_ptr<std::atomic<uint64_t>[]> entries;
+
+        Node(size_t size, bool leaf);
+    };
+
+    size_t num_levels_;
+    size_t bits_per_level_;
+    size_t entries_per_level_;
+    std::atomic<size_t> num_entries_;
+    mutable std::atomic<size_t> num_nodes_;
+
+    Node* root_;
+
+    size_t extract_level_index(PageNumber vpn, size_t level) const;
+    std::atomic<uint64_t>* walk_page_table(PageNumber vpn, bool create) const;
+    void release_node(Node* node, size_t level);
+};
+
+} // namespace vm
+
+#endif // CONCURRENT_PAGE_TABLE_H
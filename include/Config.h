@@ -6,6 +6,12 @@
 
 namespace vm {
 
+enum class CacheReplacement {
+    Lru,
+    Srrip,
+    Random
+};
+
 struct Config {
     size_t page_size;
     size_t offset_bits;
@@ -15,6 +21,44 @@ struct Config {
     size_t page_table_levels;
     size_t bits_per_level;
     size_t tlb_size;
+    size_t num_cpus;
+    size_t ipi_cost_cycles;
+    size_t invlpg_cost_cycles;
+    size_t tlb_flush_cost_cycles;
+    size_t tlb_flush_ceiling;
+    size_t shootdown_batch_limit;
+    size_t compressed_pool_size;
+    size_t tlb_hit_cycles;
+    size_t page_walk_cycles_per_level;
+    size_t page_fault_cycles;
+    size_t compress_cycles_per_kb;
+    size_t decompress_cycles_per_kb;
+    size_t swap_io_cycles;
+    size_t min_free_frames;
+    size_t low_free_frames;
+    size_t high_free_frames;
+    size_t reclaim_batch_size;
+    bool background_reclaim;
+    bool cache_model;
+    bool page_colouring;
+    CacheReplacement cache_replacement;
+    size_t cache_line_size;
+    size_t l1_cache_size;
+    size_t l1_associativity;
+    size_t l1_hit_cycles;
+    size_t l2_cache_size;
+    size_t l2_associativity;
+    size_t l2_hit_cycles;
+    size_t llc_size;
+    size_t llc_associativity;
+    size_t llc_hit_cycles;
+    size_t memory_access_cycles;
+    bool transparent_huge_pages;
+    size_t huge_tlb_size;
+    size_t thp_max_ptes_none;
+    size_t thp_scan_ranges;
+    bool thp_background_scan;
+    size_t copy_cycles_per_kb;
 
     static Config default_config() {
         Config config;
@@ -26,6 +70,44 @@ struct Config {
         config.page_table_levels = 2;
         config.bits_per_level = 10;
         config.tlb_size = 64;
+        config.num_cpus = 1;
+        config.ipi_cost_cycles = 2000;
+        config.invlpg_cost_cycles = 100;
+        config.tlb_flush_cost_cycles = 500;
+        config.tlb_flush_ceiling = 33;
+        config.shootdown_batch_limit = 32;
+        config.compressed_pool_size = config.physical_memory_size / 5;
+        config.tlb_hit_cycles = 1;
+        config.page_walk_cycles_per_level = 25;
+        config.page_fault_cycles = 2000;
+        config.compress_cycles_per_kb = 4000;
+        config.decompress_cycles_per_kb = 1000;
+        config.swap_io_cycles = 60000;
+        config.min_free_frames = config.num_frames / 128;
+        config.low_free_frames = config.min_free_frames * 5 / 4;
+        config.high_free_frames = config.min_free_frames * 3 / 2;
+        config.reclaim_batch_size = 32;
+        config.background_reclaim = false;
+        config.cache_model = false;
+        config.page_colouring = false;
+        config.cache_replacement = CacheReplacement::Lru;
+        config.cache_line_size = 64;
+        config.l1_cache_size = 32 * 1024;
+        config.l1_associativity = 8;
+        config.l1_hit_cycles = 4;
+        config.l2_cache_size = 256 * 1024;
+        config.l2_associativity = 8;
+        config.l2_hit_cycles = 12;
+        config.llc_size = 8 * 1024 * 1024;
+        config.llc_associativity = 16;
+        config.llc_hit_cycles = 40;
+        config.memory_access_cycles = 200;
+        config.transparent_huge_pages = false;
+        config.huge_tlb_size = 32;
+        config.thp_max_ptes_none = (1ULL << config.bits_per_level) / 8;
+        config.thp_scan_ranges = 8;
+        config.thp_background_scan = true;
+        config.copy_cycles_per_kb = 64;
         return config;
     }
 
@@ -39,6 +121,95 @@ struct Config {
         config.page_table_levels = 2;
         config.bits_per_level = 4;
         config.tlb_size = 8;
+        config.num_cpus = 1;
+        config.ipi_cost_cycles = 2000;
+        config.invlpg_cost_cycles = 100;
+        config.tlb_flush_cost_cycles = 500;
+        config.tlb_flush_ceiling = 4;
+        config.shootdown_batch_limit = 8;
+        config.compressed_pool_size = config.physical_memory_size / 5;
+        config.tlb_hit_cycles = 1;
+        config.page_walk_cycles_per_level = 25;
+        config.page_fault_cycles = 2000;
+        config.compress_cycles_per_kb = 4000;
+        config.decompress_cycles_per_kb = 1000;
+        config.swap_io_cycles = 60000;
+        config.min_free_frames = 2;
+        config.low_free_frames = 4;
+        config.high_free_frames = 6;
+        config.reclaim_batch_size = 4;
+        config.background_reclaim = false;
+        config.cache_model = false;
+        config.page_colouring = false;
+        config.cache_replacement = CacheReplacement::Lru;
+        config.cache_line_size = 16;
+        config.l1_cache_size = 512;
+        config.l1_associativity = 2;
+        config.l1_hit_cycles = 4;
+        config.l2_cache_size = 2 * 1024;
+        config.l2_associativity = 4;
+        config.l2_hit_cycles = 12;
+        config.llc_size = 8 * 1024;
+        config.llc_associativity = 8;
+        config.llc_hit_cycles = 40;
+        config.memory_access_cycles = 200;
+        config.transparent_huge_pages = false;
+        config.huge_tlb_size = 4;
+        config.thp_max_ptes_none = (1ULL << config.bits_per_level) / 8;
+        config.thp_scan_ranges = 4;
+        config.thp_background_scan = true;
+        config.copy_cycles_per_kb = 64;
+        return config;
+    }
+
+    static Config x86_64_config() {
+        Config config;
+        config.page_size = 4096;
+        config.offset_bits = 12;
+        config.virtual_address_bits = 48;
+        config.physical_memory_size = 1024ULL * 1024 * 1024;
+        config.num_frames = config.physical_memory_size / config.page_size;
+        config.page_table_levels = 4;
+        config.bits_per_level = 9;
+        config.tlb_size = 64;
+        config.num_cpus = 1;
+        config.ipi_cost_cycles = 2000;
+        config.invlpg_cost_cycles = 100;
+        config.tlb_flush_cost_cycles = 500;
+        config.tlb_flush_ceiling = 33;
+        config.shootdown_batch_limit = 32;
+        config.compressed_pool_size = config.physical_memory_size / 5;
+        config.tlb_hit_cycles = 1;
+        config.page_walk_cycles_per_level = 25;
+        config.page_fault_cycles = 2000;
+        config.compress_cycles_per_kb = 4000;
+        config.decompress_cycles_per_kb = 1000;
+        config.swap_io_cycles = 60000;
+        config.min_free_frames = config.num_frames / 128;
+        config.low_free_frames = config.min_free_frames * 5 / 4;
+        config.high_free_frames = config.min_free_frames * 3 / 2;
+        config.reclaim_batch_size = 32;
+        config.background_reclaim = false;
+        config.cache_model = false;
+        config.page_colouring = false;
+        config.cache_replacement = CacheReplacement::Lru;
+        config.cache_line_size = 64;
+        config.l1_cache_size = 32 * 1024;
+        config.l1_associativity = 8;
+        config.l1_hit_cycles = 4;
+        config.l2_cache_size = 256 * 1024;
+        config.l2_associativity = 8;
+        config.l2_hit_cycles = 12;
+        config.llc_size = 8 * 1024 * 1024;
+        config.llc_associativity = 16;
+        config.llc_hit_cycles = 40;
+        config.memory_access_cycles = 200;
+        config.transparent_huge_pages = false;
+        config.huge_tlb_size = 32;
+        config.thp_max_ptes_none = (1ULL << config.bits_per_level) / 8;
+        config.thp_scan_ranges = 8;
+        config.thp_background_scan = true;
+        config.copy_cycles_per_kb = 64;
         return config;
     }
 };
@@ -47,6 +218,12 @@ using VirtualAddress = uint64_t;
 using PhysicalAddress = uint64_t;
 using PageNumber = uint64_t;
 using FrameNumber = uint64_t;
+using Asid = uint16_t;
+
+constexpr uint8_t kProtNone = 0;
+constexpr uint8_t kProtRead = 1 << 0;
+constexpr uint8_t kProtWrite = 1 << 1;
+constexpr uint8_t kProtExec = 1 << 2;
 
 } // namespace vm
 
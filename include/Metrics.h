@@ -0,0 +1,302 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace vm {
+
+class MetricsRegistry;
+
+enum class MetricType {
+    Counter,
+    Gauge,
+    Histogram
+};
+
+class Counter {
+public:
+    Counter() : registry_(nullptr), slot_(0) {}
+
+    void inc(uint64_t n = 1) const;
+    uint64_t value() const;
+    void reset() const;
+
+private:
+    friend class MetricsRegistry;
+    Counter(MetricsRegistry* registry, size_t slot) : registry_(registry), slot_(slot) {}
+
+    MetricsRegistry* registry_;
+    size_t slot_;
+};
+
+class Gauge {
+public:
+    Gauge() : value_(nullptr) {}
+
+    void set(int64_t v) const { value_->store(v, std::memory_order_relaxed); }
+    void add(int64_t delta) const { value_->fetch_add(delta, std::memory_order_relaxed); }
+    int64_t value() const { return value_->load(std::memory_order_relaxed); }
+
+private:
+    friend class MetricsRegistry;
+    explicit Gauge(std::atomic<int64_t>* value) : value_(value) {}
+
+    std::atomic<int64_t>* value_;
+};
+
+// Log-linear histogram: 2^kSubBucketBits linear sub-buckets per power of two,
+// so bucket bounds are within 1/128 of any recorded value (better than two
+// significant digits). The exact minimum and maximum are tracked separately.
+class Histogram {
+public:
+    static constexpr size_t kSubBucketBits = 7;
+    static constexpr size_t kSubBuckets = 1ULL << kSubBucketBits;
+    static constexpr size_t kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+    static constexpr size_t kCountSlot = kNumBuckets;
+    static constexpr size_t kSumSlot = kNumBuckets + 1;
+    static constexpr size_t kMaxSlot = kNumBuckets + 2;
+    static constexpr size_t kMinSlot = kNumBuckets + 3;
+    static constexpr size_t kNumSlots = kNumBuckets + 4;
+
+    Histogram() : registry_(nullptr), base_(0) {}
+
+    void record(uint64_t v) const;
+    uint64_t count() const;
+    uint64_t sum() const;
+    double mean() const;
+    uint64_t percentile(double q) const;
+    uint64_t min() const;
+    uint64_t max() const;
+    void reset() const;
+
+    static size_t bucket_index(uint64_t v);
+    static uint64_t bucket_lower_bound(size_t index);
+    static uint64_t bucket_upper_bound(size_t index);
+
+private:
+    friend class MetricsRegistry;
+    Histogram(MetricsRegistry* registry, size_t base) : registry_(registry), base_(base) {}
+
+    MetricsRegistry* registry_;
+    size_t base_;
+};
+
+// Counter and histogram slots are written without contention: every thread
+// owns a private block and readers sum across blocks. A block is allocated a
+// page of slots at a time, on first write, so a thread only pays for the
+// metrics it actually updates.
+class MetricsRegistry {
+public:
+    static constexpr size_t kCacheLineSize = 64;
+    static constexpr size_t kPageBits = 8;
+    static constexpr size_t kSlotsPerPage = 1ULL << kPageBits;
+    static constexpr size_t kMaxGauges = 256;
+    static constexpr size_t kThreadCacheEntries = 4;
+
+    MetricsRegistry();
+    ~MetricsRegistry();
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    Counter counter(const std::string& name, const std::string& help = "");
+    Gauge gauge(const std::string& name, const std::string& help = "");
+    Histogram histogram(const std::string& name, const std::string& help = "");
+
+    bool has_metric(const std::string& name) const;
+    uint64_t read_slot(size_t slot) const;
+    uint64_t read_slot_max(size_t slot) const;
+    void read_slots(size_t first, size_t count, std::vector<uint64_t>& out) const;
+    void reset_slots(size_t first, size_t count);
+    void clear_slots(size_t first, size_t count);
+    void reset();
+
+    void write_prometheus(std::ostream& os, const std::string& prefix = "vm_") const;
+    void write_json(std::ostream& os) const;
+
+    size_t get_num_threads() const;
+    size_t get_slots_used() const;
+    size_t get_bytes_allocated() const;
+
+private:
+    friend class Counter;
+    friend class Histogram;
+
+    struct alignas(kCacheLineSize) SlotPage {
+        std::atomic<uint64_t> slots[kSlotsPerPage];
+
+        SlotPage() {
+            for (auto& s : slots) {
+                s.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // Only the owning thread adds pages, and only under mutex_, so readers
+    // holding mutex_ see a stable page list.
+    struct ThreadBlock {
+        std::vector<std::unique_ptr<SlotPage>> pages;
+    };
+
+    struct MetricInfo {
+        std::string name;
+        std::string help;
+        MetricType type;
+        size_t slot;
+    };
+
+    uint64_t id_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadBlock>> blocks_;
+    std::unordered_map<std::thread::id, ThreadBlock*> thread_blocks_;
+    std::vector<MetricInfo> metrics_;
+    std::unordered_map<std::string, size_t> metric_index_;
+    std::vector<uint64_t> baseline_;
+    std::unique_ptr<std::atomic<int64_t>[]> gauges_;
+    size_t next_slot_;
+    size_t next_gauge_;
+
+    ThreadBlock* local_block();
+    std::atomic<uint64_t>& block_slot(ThreadBlock& block, size_t slot);
+    ThreadBlock* attach_thread();
+    void attach_page(ThreadBlock& block, size_t page);
+    size_t register_metric(const std::string& name, const std::string& help,
+                           MetricType type, size_t slots_needed);
+    uint64_t read_slot_locked(size_t slot) const;
+    void reset_slots_locked(size_t first, size_t count);
+    void clear_slots_locked(size_t first, size_t count);
+
+    static void bump(std::atomic<uint64_t>& slot, uint64_t n);
+    static void raise(std::atomic<uint64_t>& slot, uint64_t v);
+};
+
+class MetricsExporter {
+public:
+    enum class Format {
+        Prometheus,
+        Json
+    };
+
+    MetricsExporter(const MetricsRegistry& registry, std::string path,
+                    Format format = Format::Prometheus,
+                    std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    void start();
+    void stop();
+    bool write_now() const;
+
+    bool is_running() const { return running_; }
+    size_t get_exports() const { return exports_; }
+
+private:
+    const MetricsRegistry& registry_;
+    std::string path_;
+    Format format_;
+    std::chrono::milliseconds interval_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool running_;
+    bool stop_requested_;
+    mutable std::atomic<size_t> exports_;
+
+    void run();
+};
+
+// A small per-thread cache of (registry, block) pairs, so threads that update
+// several registries only take the registry mutex the first time they meet one.
+inline MetricsRegistry::ThreadBlock* MetricsRegistry::local_block() {
+    struct CacheEntry {
+        uint64_t id;
+        ThreadBlock* block;
+    };
+    thread_local CacheEntry cache[kThreadCacheEntries] = {};
+    thread_local size_t next_victim = 0;
+
+    for (const CacheEntry& entry : cache) {
+        if (entry.id == id_) {
+            return entry.block;
+        }
+    }
+    ThreadBlock* block = attach_thread();
+    cache[next_victim] = CacheEntry{id_, block};
+    next_victim = (next_victim + 1) % kThreadCacheEntries;
+    return block;
+}
+
+inline std::atomic<uint64_t>& MetricsRegistry::block_slot(ThreadBlock& block, size_t slot) {
+    size_t page = slot >> kPageBits;
+    if (page >= block.pages.size() || !block.pages[page]) {
+        attach_page(block, page);
+    }
+    return block.pages[page]->slots[slot & (kSlotsPerPage - 1)];
+}
+
+inline void MetricsRegistry::bump(std::atomic<uint64_t>& slot, uint64_t n) {
+    slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Extremum slots may be cleared by a reader, so they need a real read-modify-write.
+inline void MetricsRegistry::raise(std::atomic<uint64_t>& slot, uint64_t v) {
+    uint64_t current = slot.load(std::memory_order_relaxed);
+    while (v > current && !slot.compare_exchange_weak(current, v, std::memory_order_relaxed)) {
+    }
+}
+
+inline void Counter::inc(uint64_t n) const {
+    MetricsRegistry::bump(registry_->block_slot(*registry_->local_block(), slot_), n);
+}
+
+inline uint64_t Counter::value() const {
+    return registry_->read_slot(slot_);
+}
+
+inline void Counter::reset() const {
+    registry_->reset_slots(slot_, 1);
+}
+
+inline size_t Histogram::bucket_index(uint64_t v) {
+    if (v < kSubBuckets) {
+        return static_cast<size_t>(v);
+    }
+    size_t exponent = 63;
+#if defined(__GNUC__) || defined(__clang__)
+    exponent = 63 - static_cast<size_t>(__builtin_clzll(v));
+#else
+    while (!(v & (1ULL << exponent))) {
+        exponent--;
+    }
+#endif
+    size_t sub = static_cast<size_t>(v >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+    return (exponent - kSubBucketBits + 1) * kSubBuckets + sub;
+}
+
+inline void Histogram::record(uint64_t v) const {
+    MetricsRegistry::ThreadBlock& block = *registry_->local_block();
+    MetricsRegistry::bump(registry_->block_slot(block, base_ + bucket_index(v)), 1);
+    MetricsRegistry::bump(registry_->block_slot(block, base_ + kCountSlot), 1);
+    MetricsRegistry::bump(registry_->block_slot(block, base_ + kSumSlot), v);
+    MetricsRegistry::raise(registry_->block_slot(block, base_ + kMaxSlot), v);
+    // The minimum is stored complemented so that zero means "no samples".
+    MetricsRegistry::raise(registry_->block_slot(block, base_ + kMinSlot), ~v);
+}
+
+} // namespace vm
+
+#endif // METRICS_H
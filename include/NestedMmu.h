@@ -0,0 +1,137 @@
+#ifndef NESTED_MMU_H
+#define NESTED_MMU_H
+
+#include "Config.h"
+#include "Metrics.h"
+#include "PageTable.h"
+#include "TLB.h"
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace vm {
+
+struct NestedPagingConfig {
+    Config guest;
+    Config host;
+    size_t tlb_size;
+    size_t nested_tlb_size;
+    size_t guest_pwc_size;
+    size_t host_pwc_size;
+    bool guest_huge_pages;
+    bool host_huge_pages;
+
+    static NestedPagingConfig x86_64_config() {
+        NestedPagingConfig config;
+        config.guest = Config::x86_64_config();
+        config.host = Config::x86_64_config();
+        config.guest.physical_memory_size = 512ULL * 1024 * 1024;
+        config.guest.num_frames = config.guest.physical_memory_size / config.guest.page_size;
+        config.tlb_size = config.guest.tlb_size;
+        config.nested_tlb_size = 0;
+        config.guest_pwc_size = 0;
+        config.host_pwc_size = 0;
+        config.guest_huge_pages = false;
+        config.host_huge_pages = false;
+        return config;
+    }
+};
+
+class PageWalkCache {
+public:
+    PageWalkCache(size_t levels, size_t bits_per_level, size_t capacity,
+                  std::shared_ptr<MetricsRegistry> metrics = nullptr,
+                  const std::string& name = "pwc");
+
+    size_t lookup(PageNumber page);
+    void insert(PageNumber page, size_t level);
+    void clear();
+
+    size_t get_capacity() const { return capacity_; }
+    size_t get_size() const { return entries_.size(); }
+    size_t get_hits() const { return hits_.value(); }
+    size_t get_misses() const { return misses_.value(); }
+
+private:
+    using LruList = std::list<uint64_t>;
+
+    size_t levels_;
+    size_t bits_per_level_;
+    size_t capacity_;
+    std::shared_ptr<MetricsRegistry> metrics_;
+    Counter hits_;
+    Counter misses_;
+
+    LruList lru_list_;
+    std::unordered_map<uint64_t, LruList::iterator> entries_;
+
+    uint64_t make_key(PageNumber page, size_t level) const;
+};
+
+class NestedMmu {
+public:
+    explicit NestedMmu(const NestedPagingConfig& config,
+                       std::shared_ptr<MetricsRegistry> metrics = nullptr);
+
+    std::optional<PhysicalAddress> translate(VirtualAddress gva);
+    void flush_tlbs();
+
+    PageTable& get_guest_page_table() { return *guest_pt_; }
+    PageTable& get_host_page_table() { return *host_pt_; }
+    TLB& get_tlb() { return *tlb_; }
+    MetricsRegistry& get_metrics() { return *metrics_; }
+    const NestedPagingConfig& get_config() const { return config_; }
+
+    size_t get_translations() const { return translations_.value(); }
+    size_t get_tlb_hits() const { return tlb_->get_hits(); }
+    size_t get_walks() const { return walks_.value(); }
+    size_t get_walk_memory_refs() const { return walk_refs_.value(); }
+    size_t get_guest_faults() const { return guest_faults_.value(); }
+    size_t get_host_faults() const { return host_faults_.value(); }
+    uint64_t get_modelled_cycles() const { return modelled_cycles_.value(); }
+    size_t get_max_walk_refs() const { return max_walk_refs_; }
+    double get_mean_walk_refs() const { return refs_per_walk_.mean(); }
+    uint64_t get_walk_refs_percentile(double p) const { return refs_per_walk_.percentile(p); }
+
+private:
+    NestedPagingConfig config_;
+    std::shared_ptr<MetricsRegistry> metrics_;
+
+    size_t guest_shift_;
+    size_t host_shift_;
+    size_t combined_shift_;
+    size_t guest_levels_;
+    size_t host_levels_;
+
+    std::unique_ptr<PageTable> guest_pt_;
+    std::unique_ptr<PageTable> host_pt_;
+    std::unique_ptr<TLB> tlb_;
+    std::unique_ptr<TLB> nested_tlb_;
+    std::unique_ptr<PageWalkCache> guest_pwc_;
+    std::unique_ptr<PageWalkCache> host_pwc_;
+
+    std::unordered_map<uint64_t, FrameNumber> guest_nodes_;
+    FrameNumber next_guest_frame_;
+    FrameNumber next_host_frame_;
+    size_t max_walk_refs_;
+
+    Counter translations_;
+    Counter walks_;
+    Counter walk_refs_;
+    Counter guest_faults_;
+    Counter host_faults_;
+    Counter out_of_memory_;
+    Counter modelled_cycles_;
+    Histogram refs_per_walk_;
+
+    std::optional<FrameNumber> allocate_frames(FrameNumber& next, size_t limit, size_t shift);
+    std::optional<FrameNumber> guest_node_frame(PageNumber gpn, size_t level);
+    bool guest_fault(PageNumber gpn);
+    std::optional<PhysicalAddress> host_translate(PhysicalAddress gpa, size_t& refs);
+};
+
+} // namespace vm
+
+#endif // NESTED_MMU_H
@@ -0,0 +1,214 @@
+#ifndef PAGE_RUN_TRACE_H
+#define PAGE_RUN_TRACE_H
+
+#include "Config.h"
+#include "Workload.h"
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vm {
+
+// Consecutive accesses to one page. The read/write order inside the run is
+// kept as alternating segment lengths starting with first_write: the run has
+// num_toggles + 1 segments, and the lengths of all but the last are stored at
+// toggle_offset in the owning chunk's segment array.
+struct PageRun {
+    PageNumber vpn;
+    uint32_t length;
+    uint32_t writes;
+    bool first_write;
+    uint32_t num_toggles;
+    uint32_t toggle_offset;
+
+    PageRun() : vpn(0), length(0), writes(0), first_write(false), num_toggles(0), toggle_offset(0) {}
+};
+
+struct PageRunChunk {
+    std::vector<PageRun> runs;
+    std::vector<uint32_t> segments;
+
+    const uint32_t* segments_of(const PageRun& run) const {
+        return run.num_toggles > 0 ? segments.data() + run.toggle_offset : nullptr;
+    }
+};
+
+// Calls fn(write, count) for each same-direction segment of a run, in order.
+template <typename Fn>
+void for_each_run_segment(const PageRun& run, const uint32_t* segments, Fn&& fn) {
+    bool write = run.first_write;
+    uint32_t done = 0;
+    for (uint32_t i = 0; i < run.num_toggles; ++i) {
+        fn(write, segments[i]);
+        done += segments[i];
+        write = !write;
+    }
+    fn(write, run.length - done);
+}
+
+struct PageRunChunkInfo {
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t runs;
+    uint64_t accesses;
+    PageNumber first_vpn;
+};
+
+class RawTraceReader {
+public:
+    explicit RawTraceReader(std::istream& in);
+
+    size_t read(MemoryAccess* out, size_t count);
+    size_t get_lines() const { return lines_; }
+    size_t get_skipped_lines() const { return skipped_; }
+
+private:
+    std::istream& in_;
+    std::vector<char> buffer_;
+    size_t begin_;
+    size_t end_;
+    bool eof_;
+    size_t lines_;
+    size_t skipped_;
+
+    bool next_line(const char*& line, size_t& length);
+    static bool parse_line(const char* line, size_t length, MemoryAccess& access);
+};
+
+class PageRunWriter {
+public:
+    static constexpr size_t kDefaultRunsPerChunk = 65536;
+
+    PageRunWriter(const std::string& path, size_t page_shift,
+                  size_t runs_per_chunk = kDefaultRunsPerChunk);
+    ~PageRunWriter();
+
+    PageRunWriter(const PageRunWriter&) = delete;
+    PageRunWriter& operator=(const PageRunWriter&) = delete;
+
+    void add(VirtualAddress vaddr, bool write);
+    void add(const MemoryAccess* accesses, size_t count);
+    void close();
+
+    size_t get_accesses() const { return accesses_; }
+    size_t get_runs() const { return runs_; }
+    size_t get_chunks() const { return index_.size(); }
+    uint64_t get_bytes_written() const { return bytes_written_; }
+
+private:
+    std::ofstream out_;
+    size_t page_shift_;
+    size_t runs_per_chunk_;
+    bool closed_;
+
+    PageRun current_;
+    bool current_write_;
+    uint32_t current_segment_;
+    std::vector<PageRun> pending_;
+    std::vector<uint32_t> pending_segments_;
+    std::vector<PageRunChunkInfo> index_;
+    std::vector<uint8_t> scratch_;
+    size_t accesses_;
+    size_t runs_;
+    uint64_t bytes_written_;
+
+    void end_run();
+    void flush_chunk();
+    void write_bytes(const uint8_t* data, size_t size);
+};
+
+class PageRunReader {
+public:
+    explicit PageRunReader(const std::string& path);
+
+    size_t get_page_shift() const { return page_shift_; }
+    size_t get_num_chunks() const { return index_.size(); }
+    const PageRunChunkInfo& get_chunk_info(size_t chunk) const { return index_.at(chunk); }
+    uint64_t get_total_accesses() const;
+    uint64_t get_total_runs() const;
+
+    void read_chunk(size_t chunk, PageRunChunk& out);
+    void read_chunk_bytes(size_t chunk, std::vector<uint8_t>& bytes);
+
+    static void decode_chunk(const uint8_t* data, size_t size, size_t expected_runs,
+                             PageRunChunk& out);
+
+private:
+    std::ifstream in_;
+    std::mutex in_mutex_;
+    size_t page_shift_;
+    std::vector<PageRunChunkInfo> index_;
+};
+
+// Decodes the chunks of a trace in order on persistent background threads,
+// staying at most depth chunks ahead of the consumer, so decoding overlaps
+// replay instead of alternating with it.
+class PageRunPrefetcher {
+public:
+    explicit PageRunPrefetcher(PageRunReader& reader, size_t num_threads = 0, size_t depth = 0);
+    ~PageRunPrefetcher();
+
+    PageRunPrefetcher(const PageRunPrefetcher&) = delete;
+    PageRunPrefetcher& operator=(const PageRunPrefetcher&) = delete;
+
+    bool next(PageRunChunk& out);
+
+private:
+    struct Slot {
+        PageRunChunk chunk;
+        bool ready;
+        std::exception_ptr error;
+
+        Slot() : ready(false) {}
+    };
+
+    PageRunReader& reader_;
+    size_t num_chunks_;
+    std::vector<Slot> slots_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable ready_cv_;
+    std::condition_variable space_cv_;
+    size_t next_claim_;
+    size_t next_consume_;
+    bool stop_requested_;
+
+    void run();
+};
+
+struct TraceConversionStats {
+    size_t accesses;
+    size_t runs;
+    size_t chunks;
+    uint64_t output_bytes;
+    size_t skipped_lines;
+
+    TraceConversionStats() : accesses(0), runs(0), chunks(0), output_bytes(0), skipped_lines(0) {}
+};
+
+struct TraceVerificationStats {
+    uint64_t accesses;
+    uint64_t mismatches;
+    uint64_t first_mismatch;
+    size_t chunks;
+
+    TraceVerificationStats() : accesses(0), mismatches(0), first_mismatch(0), chunks(0) {}
+
+    bool matches() const { return mismatches == 0; }
+};
+
+TraceConversionStats convert_raw_trace(std::istream& raw, const std::string& output_path,
+                                       size_t page_shift,
+                                       size_t runs_per_chunk = PageRunWriter::kDefaultRunsPerChunk);
+TraceVerificationStats verify_page_run_trace(std::istream& raw, PageRunReader& reader);
+WorkloadRunStats replay_page_runs(VirtualMemoryManager& vmm, PageRunReader& reader);
+
+} // namespace vm
+
+#endif // PAGE_RUN_TRACE_H
@@ -5,6 +5,7 @@
 #include <vector>
 #include <memory>
 #include <optional>
+#include <utility>
 
 namespace vm {
 
@@ -13,9 +14,12 @@ struct PageTableEntry {
     bool valid;
     bool dirty;
     bool referenced;
+    bool huge;
+    uint8_t protection;
 
     PageTableEntry()
-        : frame_number(0), valid(false), dirty(false), referenced(false) {}
+        : frame_number(0), valid(false), dirty(false), referenced(false), huge(false),
+          protection(kProtRead | kProtWrite) {}
 };
 
 class PageTable {
@@ -23,15 +27,30 @@ public:
     PageTable(const Config& config);
 
     std::optional<FrameNumber> translate(PageNumber vpn);
-    void insert(PageNumber vpn, FrameNumber pfn);
+    void insert(PageNumber vpn, FrameNumber pfn, uint8_t protection = kProtRead | kProtWrite);
     bool is_present(PageNumber vpn) const;
     PageTableEntry* get_entry(PageNumber vpn);
     void set_dirty(PageNumber vpn, bool dirty = true);
     void set_referenced(PageNumber vpn, bool referenced = true);
     void invalidate(PageNumber vpn);
+    size_t unmap_range(PageNumber start, PageNumber end,
+                       std::vector<std::pair<PageNumber, FrameNumber>>& unmapped);
+    size_t protect_range(PageNumber start, PageNumber end, uint8_t protection);
     void clear();
 
+    // Huge mappings replace a whole last-level table with one entry in its
+    // parent. get_entry() returns that entry for any page it covers.
+    bool collapse(PageNumber base, FrameNumber base_pfn, uint8_t protection, bool dirty);
+    size_t split_range(PageNumber start, PageNumber end);
+    const PageTableEntry* get_leaf_entries(PageNumber vpn);
+    FrameNumber frame_for(const PageTableEntry& entry, PageNumber vpn) const {
+        return entry.huge ? entry.frame_number + (vpn & (entries_per_level_ - 1)) : entry.frame_number;
+    }
+
+    size_t get_huge_page_pages() const { return num_levels_ > 1 ? entries_per_level_ : 0; }
     size_t get_num_entries() const { return num_entries_; }
+    size_t get_num_huge_entries() const { return num_huge_entries_; }
+    size_t get_num_nodes() const { return num_nodes_; }
 
 private:
     Config config_;
@@ -39,10 +58,13 @@ private:
     size_t bits_per_level_;
     size_t entries_per_level_;
     size_t num_entries_;
+    size_t num_huge_entries_;
+    size_t num_nodes_;
 
     struct PageTableNode {
         std::vector<std::unique_ptr<PageTableNode>> children;
         std::vector<PageTableEntry> entries;
+        std::vector<PageTableEntry> huge;
         bool is_leaf;
 
         PageTableNode(size_t size, bool leaf) : is_leaf(leaf) {
@@ -57,7 +79,19 @@ private:
     std::unique_ptr<PageTableNode> root_;
 
     size_t extract_level_index(PageNumber vpn, size_t level) const;
+    PageNumber level_span(size_t level) const;
     PageTableEntry* walk_page_table(PageNumber vpn, bool create);
+    PageTableNode* walk_to_huge_level(PageNumber vpn, bool create);
+    size_t split_node(PageTableNode* node, size_t level, PageNumber base,
+                      PageNumber start, PageNumber end);
+    bool unmap_node(PageTableNode* node, size_t level, PageNumber base,
+                    PageNumber start, PageNumber end,
+                    std::vector<std::pair<PageNumber, FrameNumber>>& unmapped);
+    void release_subtree(std::unique_ptr<PageTableNode>& node, size_t level, PageNumber base,
+                         std::vector<std::pair<PageNumber, FrameNumber>>& unmapped);
+    template <typename Fn>
+    void for_each_leaf(PageTableNode* node, size_t level, PageNumber base,
+                       PageNumber start, PageNumber end, Fn&& fn);
 };
 
 } // namespace vm
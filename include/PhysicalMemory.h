@@ -2,9 +2,12 @@
 #define PHYSICAL_MEMORY_H
 
 #include "Config.h"
-#include <vector>
-#include <queue>
+#include "Metrics.h"
+#include <limits>
+#include <memory>
 #include <optional>
+#include <set>
+#include <vector>
 
 namespace vm {
 
@@ -12,41 +15,81 @@ struct Frame {
     bool allocated;
     PageNumber owner_vpn;
     bool pinned;
+    bool reclaimed;
 
-    Frame() : allocated(false), owner_vpn(0), pinned(false) {}
+    Frame() : allocated(false), owner_vpn(0), pinned(false), reclaimed(false) {}
 };
 
 class PhysicalMemory {
 public:
-    explicit PhysicalMemory(const Config& config);
+    explicit PhysicalMemory(const Config& config, std::shared_ptr<MetricsRegistry> metrics = nullptr);
 
     std::optional<FrameNumber> allocate_frame(PageNumber vpn);
-    void free_frame(FrameNumber pfn);
+    std::optional<FrameNumber> allocate_contiguous(size_t count, PageNumber first_vpn);
+    void free_frame(FrameNumber pfn, bool reclaimed = false);
     bool is_allocated(FrameNumber pfn) const;
     const Frame& get_frame(FrameNumber pfn) const;
     void pin_frame(FrameNumber pfn);
     void unpin_frame(FrameNumber pfn);
     uint8_t read_byte(PhysicalAddress addr);
     void write_byte(PhysicalAddress addr, uint8_t value);
+    uint8_t* get_frame_data(FrameNumber pfn);
+    void zero_frame(FrameNumber pfn);
+    std::optional<FrameNumber> next_victim_candidate();
 
+    size_t get_page_size() const { return config_.page_size; }
     size_t get_num_frames() const { return num_frames_; }
-    size_t get_free_frames() const { return free_frames_.size(); }
+    size_t get_free_frames() const { return num_free_frames_; }
+    size_t get_num_colours() const { return free_lists_.size(); }
+    size_t get_frame_colour(FrameNumber pfn) const { return pfn % free_lists_.size(); }
+    size_t get_colour_fallbacks() const { return colour_fallbacks_.value(); }
     size_t get_allocated_frames() const { return allocated_frames_; }
-    size_t get_page_faults() const { return page_faults_; }
+    size_t get_frame_allocations() const { return frame_allocations_.value(); }
+    size_t get_contiguous_failures() const { return contiguous_failures_.value(); }
+    size_t get_run_frames() const { return run_frames_; }
+    size_t get_free_runs() const { return free_runs_.size(); }
 
-    void reset_stats() { page_faults_ = 0; }
+    void reset_stats() { frame_allocations_.reset(); }
 
 private:
     Config config_;
     size_t num_frames_;
     size_t allocated_frames_;
-    size_t page_faults_;
+    FrameNumber clock_hand_;
+    size_t num_free_frames_;
+
+    std::shared_ptr<MetricsRegistry> metrics_;
+    Counter frame_allocations_;
+    Counter colour_fallbacks_;
+    Counter contiguous_allocations_;
+    Counter contiguous_failures_;
+    Gauge allocated_gauge_;
+    Gauge free_gauge_;
 
     std::vector<Frame> frames_;
     std::vector<uint8_t> memory_;
-    std::queue<FrameNumber> free_frames_;
+    // Free frames of each colour form a FIFO threaded through free_next_ and
+    // free_prev_, so allocate_contiguous() can unlink frames in O(1).
+    struct FreeList {
+        FrameNumber head;
+        FrameNumber tail;
+        size_t size;
+    };
+    static constexpr FrameNumber kNoFrame = std::numeric_limits<FrameNumber>::max();
+
+    std::vector<FreeList> free_lists_;
+    std::vector<FrameNumber> free_next_;
+    std::vector<FrameNumber> free_prev_;
+
+    // Aligned runs of run_frames_ frames (one huge page): free frames per
+    // run, and the runs that are entirely free.
+    size_t run_frames_;
+    std::vector<size_t> run_free_;
+    std::set<size_t> free_runs_;
 
-    std::optional<FrameNumber> find_victim_frame();
+    void push_free_frame(FrameNumber pfn);
+    void unlink_free_frame(FrameNumber pfn);
+    void take_frame(FrameNumber pfn, PageNumber vpn);
 };
 
 } // namespace vm
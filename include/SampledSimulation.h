@@ -0,0 +1,94 @@
+#ifndef SAMPLED_SIMULATION_H
+#define SAMPLED_SIMULATION_H
+
+#include "Config.h"
+#include "Workload.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vm {
+
+class VirtualMemoryManager;
+
+struct SamplingConfig {
+    size_t interval_length;
+    size_t warmup_length;
+    size_t signature_dims;
+    size_t max_phases;
+    size_t samples_per_phase;
+    size_t kmeans_iterations;
+    double bic_threshold;
+    double z_score;
+    uint64_t seed;
+
+    static SamplingConfig default_config() {
+        SamplingConfig config;
+        config.interval_length = 10000;
+        config.warmup_length = 2000;
+        config.signature_dims = 32;
+        config.max_phases = 10;
+        config.samples_per_phase = 3;
+        config.kmeans_iterations = 20;
+        config.bic_threshold = 0.9;
+        config.z_score = 1.96;
+        config.seed = 1;
+        return config;
+    }
+};
+
+// Intervals of a workload grouped into phases by their page-access signature.
+// samples[p] lists the intervals simulated in detail for phase p; the first is
+// the interval closest to the phase centroid, the rest are drawn at random.
+struct PhaseProfile {
+    SamplingConfig config;
+    size_t num_accesses;
+    size_t num_intervals;
+    size_t num_phases;
+    std::vector<uint32_t> phase_of;
+    std::vector<double> phase_weights;
+    std::vector<std::vector<size_t>> samples;
+
+    PhaseProfile() : num_accesses(0), num_intervals(0), num_phases(0) {}
+
+    size_t get_num_samples() const;
+};
+
+// interval_known is false when some phase's variance could not be estimated
+// (it had a single sample and no other phase had two); half_width is then
+// infinite rather than a misleading zero.
+struct SampledEstimate {
+    double value;
+    double half_width;
+    bool interval_known;
+
+    SampledEstimate() : value(0.0), half_width(0.0), interval_known(true) {}
+
+    double lower() const { return value - half_width; }
+    double upper() const { return value + half_width; }
+    double relative_half_width() const { return value != 0.0 ? half_width / value : 0.0; }
+};
+
+struct SampledRunStats {
+    size_t accesses;
+    size_t detailed_accesses;
+    size_t warmup_accesses;
+    size_t fast_forwarded_accesses;
+    size_t detailed_intervals;
+    SampledEstimate modelled_cycles;
+    SampledEstimate tlb_misses;
+    SampledEstimate page_faults;
+
+    SampledRunStats()
+        : accesses(0), detailed_accesses(0), warmup_accesses(0), fast_forwarded_accesses(0),
+          detailed_intervals(0) {}
+};
+
+PhaseProfile profile_phases(WorkloadGenerator& generator, size_t count, size_t page_shift,
+                            const SamplingConfig& config = SamplingConfig::default_config());
+SampledRunStats run_sampled(VirtualMemoryManager& vmm, WorkloadGenerator& generator,
+                            const PhaseProfile& profile, bool map_footprint = true);
+
+} // namespace vm
+
+#endif // SAMPLED_SIMULATION_H
@@ -0,0 +1,77 @@
+#ifndef SHARED_ADDRESS_SPACE_H
+#define SHARED_ADDRESS_SPACE_H
+
+#include "Config.h"
+#include "ConcurrentPageTable.h"
+#include "Metrics.h"
+#include "TLB.h"
+#include "VMA.h"
+#include "Workload.h"
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace vm {
+
+struct ParallelReplayStats {
+    size_t threads;
+    WorkloadRunStats totals;
+    std::vector<double> tlb_hit_rates;
+    double seconds;
+
+    ParallelReplayStats() : threads(0), seconds(0.0) {}
+
+    double get_throughput() const {
+        return seconds > 0.0 ? static_cast<double>(totals.accesses) / seconds : 0.0;
+    }
+};
+
+class SharedAddressSpace {
+public:
+    explicit SharedAddressSpace(const Config& config,
+                                std::shared_ptr<MetricsRegistry> metrics = nullptr);
+
+    // Regions must be mapped before any thread starts translating; the VMA
+    // tree is read without locks on the fault path.
+    bool mmap(VirtualAddress addr, size_t length, uint8_t protection);
+    std::unique_ptr<TLB> create_tlb(size_t thread) const;
+    std::optional<PhysicalAddress> translate(TLB& tlb, VirtualAddress vaddr, bool write = false);
+    ParallelReplayStats replay(std::vector<std::unique_ptr<WorkloadGenerator>>& workloads,
+                               size_t accesses_per_thread);
+
+    ConcurrentPageTable& get_page_table() { return page_table_; }
+    MetricsRegistry& get_metrics() { return *metrics_; }
+    const Config& get_config() const { return config_; }
+
+    size_t get_total_accesses() const { return total_accesses_.value(); }
+    size_t get_page_faults() const { return page_faults_.value(); }
+    size_t get_fault_races() const { return fault_races_.value(); }
+    size_t get_segfaults() const { return segfaults_.value(); }
+    size_t get_protection_faults() const { return protection_faults_.value(); }
+    size_t get_allocated_frames() const { return next_frame_.load(std::memory_order_relaxed); }
+    uint64_t get_modelled_cycles() const { return modelled_cycles_.value(); }
+
+private:
+    Config config_;
+    std::shared_ptr<MetricsRegistry> metrics_;
+    ConcurrentPageTable page_table_;
+    VmaTree vmas_;
+    std::atomic<FrameNumber> next_frame_;
+    uint64_t walk_cycles_;
+
+    Counter total_accesses_;
+    Counter page_faults_;
+    Counter fault_races_;
+    Counter segfaults_;
+    Counter protection_faults_;
+    Counter out_of_memory_;
+    Counter modelled_cycles_;
+
+    std::optional<FrameNumber> allocate_frame();
+    std::optional<FrameNumber> handle_page_fault(PageNumber vpn, uint8_t protection);
+};
+
+} // namespace vm
+
+#endif // SHARED_ADDRESS_SPACE_H
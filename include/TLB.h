@@ -2,42 +2,99 @@
 #define TLB_H
 
 #include "Config.h"
+#include "Metrics.h"
 #include <unordered_map>
 #include <list>
+#include <memory>
 #include <optional>
+#include <string>
 
 namespace vm {
 
+struct TlbKey {
+    Asid asid;
+    PageNumber vpn;
+
+    bool operator==(const TlbKey& other) const {
+        return asid == other.asid && vpn == other.vpn;
+    }
+};
+
+struct TlbKeyHash {
+    size_t operator()(const TlbKey& key) const {
+        return std::hash<uint64_t>()(key.vpn * 0x9E3779B97F4A7C15ULL ^ key.asid);
+    }
+};
+
 class TLB {
 public:
-    explicit TLB(size_t capacity);
+    explicit TLB(size_t capacity, std::shared_ptr<MetricsRegistry> metrics = nullptr,
+                 const std::string& name = "tlb", size_t huge_capacity = 0, size_t huge_shift = 0);
 
     std::optional<FrameNumber> lookup(PageNumber vpn);
     void insert(PageNumber vpn, FrameNumber pfn);
+    void insert_huge(PageNumber vpn, FrameNumber base_pfn);
     void invalidate(PageNumber vpn);
+    void invalidate(Asid asid, PageNumber vpn);
+    size_t invalidate_range(PageNumber start, PageNumber end);
+    size_t invalidate_range(Asid asid, PageNumber start, PageNumber end);
+    size_t invalidate_asid(Asid asid);
     void clear();
+    void record_hits(size_t count) { hits_.inc(count); }
+
+    void set_asid(Asid asid) { current_asid_ = asid; }
+    Asid get_asid() const { return current_asid_; }
+    bool holds_asid(Asid asid) const { return asid_entries_.count(asid) > 0; }
 
-    size_t get_hits() const { return hits_; }
-    size_t get_misses() const { return misses_; }
+    size_t get_capacity() const { return base_.capacity; }
+    size_t get_size() const { return base_.map.size(); }
+    size_t get_huge_capacity() const { return huge_.capacity; }
+    size_t get_huge_size() const { return huge_.map.size(); }
+    size_t get_hits() const { return hits_.value(); }
+    size_t get_huge_hits() const { return huge_hits_.value(); }
+    size_t get_misses() const { return misses_.value(); }
+    size_t get_invalidations() const { return invalidations_.value(); }
     double get_hit_rate() const {
-        size_t total = hits_ + misses_;
-        return total > 0 ? static_cast<double>(hits_) / total : 0.0;
+        size_t hits = get_hits();
+        size_t total = hits + get_misses();
+        return total > 0 ? static_cast<double>(hits) / total : 0.0;
     }
 
     void reset_stats() {
-        hits_ = 0;
-        misses_ = 0;
+        hits_.reset();
+        misses_.reset();
+        huge_hits_.reset();
     }
 
 private:
-    size_t capacity_;
-    size_t hits_;
-    size_t misses_;
+    using LruList = std::list<TlbKey>;
+    using EntryMap = std::unordered_map<TlbKey, std::pair<FrameNumber, LruList::iterator>, TlbKeyHash>;
+
+    // Base-page and huge-page entries live in separate fully associative sets,
+    // as in split L1 DTLBs. Huge entries are keyed by vpn >> huge_shift_.
+    struct EntrySet {
+        size_t capacity;
+        LruList lru_list;
+        EntryMap map;
+
+        explicit EntrySet(size_t cap) : capacity(cap) {}
+    };
+
+    Asid current_asid_;
+    size_t huge_shift_;
+    std::shared_ptr<MetricsRegistry> metrics_;
+    Counter hits_;
+    Counter misses_;
+    Counter huge_hits_;
+    Counter invalidations_;
 
-    std::list<PageNumber> lru_list_;
-    std::unordered_map<PageNumber, std::pair<FrameNumber, std::list<PageNumber>::iterator>> cache_;
+    EntrySet base_;
+    EntrySet huge_;
+    std::unordered_map<Asid, size_t> asid_entries_;
 
-    void touch(PageNumber vpn);
+    void insert_entry(EntrySet& set, TlbKey key, FrameNumber pfn);
+    size_t invalidate_keys(EntrySet& set, Asid asid, PageNumber start, PageNumber end);
+    void erase(EntrySet& set, EntryMap::iterator it);
 };
 
 } // namespace vm
@@ -0,0 +1,66 @@
+#ifndef TLB_SHOOTDOWN_H
+#define TLB_SHOOTDOWN_H
+
+#include "Config.h"
+#include "Metrics.h"
+#include "TLB.h"
+#include <memory>
+#include <vector>
+
+namespace vm {
+
+struct InvalidationRange {
+    Asid asid;
+    PageNumber start;
+    PageNumber end;
+};
+
+struct ShootdownResult {
+    size_t ranges;
+    size_t ipis;
+    size_t entries_invalidated;
+    uint64_t cycles;
+
+    ShootdownResult() : ranges(0), ipis(0), entries_invalidated(0), cycles(0) {}
+};
+
+class TlbShootdownBatch {
+public:
+    TlbShootdownBatch(const Config& config, std::shared_ptr<MetricsRegistry> metrics = nullptr);
+
+    void add_range(Asid asid, PageNumber start, PageNumber end);
+    void add_asid(Asid asid);
+    ShootdownResult flush(const std::vector<TLB*>& tlbs, size_t initiator);
+
+    bool empty() const { return pending_.empty(); }
+    bool should_flush() const { return pending_.size() >= batch_limit_; }
+    size_t get_pending() const { return pending_.size(); }
+
+    size_t get_ipis() const { return ipis_.value(); }
+    size_t get_flushes() const { return flushes_.value(); }
+    uint64_t get_cycles() const { return cycles_.value(); }
+
+private:
+    size_t batch_limit_;
+    size_t flush_ceiling_;
+    size_t ipi_cost_cycles_;
+    size_t invlpg_cost_cycles_;
+    size_t tlb_flush_cost_cycles_;
+
+    std::vector<InvalidationRange> pending_;
+
+    std::shared_ptr<MetricsRegistry> metrics_;
+    Counter flushes_;
+    Counter ranges_queued_;
+    Counter ranges_flushed_;
+    Counter ipis_;
+    Counter full_flushes_;
+    Counter cycles_;
+    Histogram ranges_per_flush_;
+
+    void coalesce();
+};
+
+} // namespace vm
+
+#endif // TLB_SHOOTDOWN_H
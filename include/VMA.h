@@ -0,0 +1,65 @@
+#ifndef VMA_H
+#define VMA_H
+
+#include "Config.h"
+#include <map>
+#include <optional>
+#include <vector>
+
+namespace vm {
+
+enum class VmaBacking {
+    Anonymous,
+    File
+};
+
+struct VirtualMemoryArea {
+    VirtualAddress start;
+    VirtualAddress end;
+    uint8_t protection;
+    VmaBacking backing;
+
+    VirtualMemoryArea()
+        : start(0), end(0), protection(kProtNone), backing(VmaBacking::Anonymous) {}
+
+    VirtualMemoryArea(VirtualAddress s, VirtualAddress e, uint8_t prot, VmaBacking b)
+        : start(s), end(e), protection(prot), backing(b) {}
+
+    size_t length() const { return end - start; }
+    bool contains(VirtualAddress addr) const { return addr >= start && addr < end; }
+    bool allows(bool write) const {
+        return (protection & (write ? kProtWrite : kProtRead)) != 0;
+    }
+};
+
+class VmaTree {
+public:
+    VmaTree() = default;
+
+    const VirtualMemoryArea* find(VirtualAddress addr) const;
+    bool overlaps(VirtualAddress start, VirtualAddress end) const;
+    bool is_fully_mapped(VirtualAddress start, VirtualAddress end) const;
+
+    void insert(const VirtualMemoryArea& vma);
+    std::vector<VirtualMemoryArea> remove_range(VirtualAddress start, VirtualAddress end);
+    bool protect_range(VirtualAddress start, VirtualAddress end, uint8_t protection);
+
+    std::optional<VirtualAddress> find_free_range(size_t length, VirtualAddress lower,
+                                                  VirtualAddress upper) const;
+
+    std::vector<VirtualMemoryArea> get_areas() const;
+    size_t get_num_areas() const { return areas_.size(); }
+    size_t get_mapped_bytes() const { return mapped_bytes_; }
+    void clear();
+
+private:
+    std::map<VirtualAddress, VirtualMemoryArea> areas_;
+    size_t mapped_bytes_ = 0;
+
+    void split_at(VirtualAddress addr);
+    void try_merge(VirtualAddress start);
+};
+
+} // namespace vm
+
+#endif // VMA_H
@@ -2,46 +2,192 @@
 #define VIRTUAL_MEMORY_MANAGER_H
 
 #include "Config.h"
+#include "CacheHierarchy.h"
+#include "CompressedPool.h"
+#include "Metrics.h"
 #include "TLB.h"
+#include "TlbShootdown.h"
 #include "PageTable.h"
+#include "PageRunTrace.h"
 #include "PhysicalMemory.h"
+#include "BackgroundWorker.h"
+#include "VMA.h"
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <iostream>
 
 namespace vm {
 
+enum class EvictedLocation {
+    SameFilled,
+    Compressed,
+    Swap
+};
+
+enum class CollapseResult {
+    Promoted,
+    Skipped,
+    Refused
+};
+
+struct EvictedPage {
+    EvictedLocation location;
+    uint8_t fill;
+    CompressedHandle handle;
+    std::list<PageNumber>::iterator lru;
+    std::vector<uint8_t> data;
+
+    EvictedPage() : location(EvictedLocation::SameFilled), fill(0), handle(0) {}
+};
+
+struct FastForwardResult {
+    size_t faults;
+    uint64_t fault_cycles;
+
+    FastForwardResult() : faults(0), fault_cycles(0) {}
+};
+
 class VirtualMemoryManager {
 public:
-    explicit VirtualMemoryManager(const Config& config);
+    explicit VirtualMemoryManager(const Config& config,
+                                  std::shared_ptr<MetricsRegistry> metrics = nullptr);
+    ~VirtualMemoryManager();
 
     std::optional<PhysicalAddress> translate(VirtualAddress vaddr, bool write = false);
+    std::optional<PhysicalAddress> access(VirtualAddress vaddr, bool write = false);
+    size_t access_run(const PageRun& run, const uint32_t* segments = nullptr);
+    size_t access_runs(const PageRunChunk& chunk);
+    FastForwardResult fast_forward(const MemoryAccess* accesses, size_t count);
     uint8_t read_byte(VirtualAddress vaddr);
     void write_byte(VirtualAddress vaddr, uint8_t value);
     bool allocate_page(VirtualAddress vaddr);
     void free_page(VirtualAddress vaddr);
+    std::optional<VirtualAddress> mmap(VirtualAddress addr, size_t length, uint8_t protection,
+                                       VmaBacking backing = VmaBacking::Anonymous,
+                                       bool fixed = false);
+    bool munmap(VirtualAddress addr, size_t length);
+    bool mprotect(VirtualAddress addr, size_t length, uint8_t protection);
+    ShootdownResult flush_tlb_shootdowns();
+    size_t collapse_huge_pages(size_t max_ranges);
+    void set_cpu(size_t cpu);
     void print_statistics(std::ostream& os = std::cout) const;
     void reset_statistics();
 
     TLB& get_tlb() { return *tlb_; }
+    TLB& get_tlb(size_t cpu) { return *tlbs_.at(cpu); }
+    size_t get_cpu() const { return current_cpu_; }
+    size_t get_num_cpus() const { return tlbs_.size(); }
+    TlbShootdownBatch& get_shootdown_batch() { return shootdown_; }
     PageTable& get_page_table() { return *page_table_; }
     PhysicalMemory& get_physical_memory() { return *physical_memory_; }
+    CompressedPool& get_compressed_pool() { return *compressed_pool_; }
+    BackgroundWorker* get_reclaim_daemon() { return reclaimd_.get(); }
+    BackgroundWorker* get_khugepaged() { return khugepaged_.get(); }
+    CacheHierarchy* get_caches() { return caches_.get(); }
+    const VmaTree& get_vmas() const { return vmas_; }
+    MetricsRegistry& get_metrics() { return *metrics_; }
+    std::shared_ptr<MetricsRegistry> get_metrics_registry() const { return metrics_; }
+
+    size_t get_total_accesses() const { return total_accesses_.value(); }
+    size_t get_tlb_hits() const;
+    size_t get_tlb_misses() const;
+    size_t get_tlb_huge_hits() const;
+    size_t get_page_table_hits() const { return page_table_hits_.value(); }
+    size_t get_page_faults() const { return page_faults_.value(); }
+    size_t get_segfaults() const { return segfaults_.value(); }
+    size_t get_protection_faults() const { return protection_faults_.value(); }
+    size_t get_evictions() const { return evictions_.value(); }
+    size_t get_evicted_pages() const { return evicted_pages_.size(); }
+    size_t get_prereclaimed_faults() const { return prereclaimed_faults_.value(); }
+    size_t get_direct_reclaim_faults() const { return direct_reclaim_faults_.value(); }
+    size_t get_background_reclaimed_pages() const { return background_reclaimed_.value(); }
+    size_t get_direct_reclaimed_pages() const { return direct_reclaimed_.value(); }
+    uint64_t get_modelled_cycles() const { return modelled_cycles_.value(); }
+    uint64_t get_fault_cycles() const { return fault_cycles_.sum(); }
+    size_t get_huge_promotions() const { return thp_promotions_.value(); }
+    size_t get_huge_promotions_in_place() const { return thp_promotions_in_place_.value(); }
+    size_t get_huge_collapse_failures() const { return thp_collapse_failures_.value(); }
+    size_t get_huge_pages_copied() const { return thp_pages_copied_.value(); }
+    uint64_t get_huge_collapse_cycles() const { return thp_collapse_cycles_.value(); }
+    size_t get_huge_demotions() const { return thp_demotions_.value(); }
+    size_t get_huge_mappings() const { return page_table_->get_num_huge_entries(); }
 
     const Config& get_config() const { return config_; }
 
 private:
     Config config_;
-    std::unique_ptr<TLB> tlb_;
+    std::shared_ptr<MetricsRegistry> metrics_;
+    std::vector<std::unique_ptr<TLB>> tlbs_;
+    TLB* tlb_;
+    size_t current_cpu_;
     std::unique_ptr<PageTable> page_table_;
     std::unique_ptr<PhysicalMemory> physical_memory_;
+    VmaTree vmas_;
+    TlbShootdownBatch shootdown_;
+    std::vector<FrameNumber> deferred_frees_;
+    std::vector<FrameNumber> reclaimed_frees_;
+    std::unique_ptr<CompressedPool> compressed_pool_;
+    std::unique_ptr<CacheHierarchy> caches_;
+    std::map<PageNumber, EvictedPage> evicted_pages_;
+    std::list<PageNumber> compressed_lru_;
+    uint64_t walk_cycles_;
+    uint64_t huge_walk_cycles_;
+    PageNumber thp_scan_cursor_;
+    mutable std::recursive_mutex mm_mutex_;
+
+    Counter total_accesses_;
+    Counter page_table_hits_;
+    Counter page_faults_;
+    Counter segfaults_;
+    Counter protection_faults_;
+    Counter pages_unmapped_;
+    Counter evictions_;
+    Counter same_filled_evictions_;
+    Counter swap_outs_;
+    Counter swap_ins_;
+    Counter compressed_faults_;
+    Counter modelled_cycles_;
+    Counter prereclaimed_faults_;
+    Counter direct_reclaim_faults_;
+    Counter background_reclaimed_;
+    Counter direct_reclaimed_;
+    Counter background_reclaim_cycles_;
+    Counter thp_ranges_scanned_;
+    Counter thp_promotions_;
+    Counter thp_promotions_in_place_;
+    Counter thp_collapse_failures_;
+    Counter thp_pages_copied_;
+    Counter thp_collapse_cycles_;
+    Counter thp_demotions_;
+    Histogram fault_cycles_;
+    Histogram direct_reclaim_stall_cycles_;
 
-    size_t total_accesses_;
-    size_t tlb_hits_;
-    size_t page_table_hits_;
-    size_t page_faults_;
+    std::unique_ptr<BackgroundWorker> reclaimd_;
+    std::unique_ptr<BackgroundWorker> khugepaged_;
 
     PageNumber extract_page_number(VirtualAddress vaddr) const;
     size_t extract_offset(VirtualAddress vaddr) const;
-    bool handle_page_fault(PageNumber vpn);
+    VirtualAddress address_space_limit() const;
+    size_t page_align_up(size_t length) const;
+    std::unique_lock<std::recursive_mutex> lock_mm() const;
+    std::optional<PhysicalAddress> translate_locked(VirtualAddress vaddr, bool write);
+    size_t access_run_locked(const PageRun& run, const uint32_t* segments);
+    bool handle_page_fault(PageNumber vpn, uint8_t protection, uint64_t& cycles);
+    void queue_invalidation(PageNumber start, PageNumber end);
+    bool ensure_free_frame(uint64_t& cycles, bool& direct_reclaim);
+    size_t reclaim_pages(size_t count, bool background, uint64_t& cycles);
+    size_t background_reclaim();
+    std::optional<FrameNumber> select_victim();
+    uint64_t evict_page(FrameNumber pfn, bool background);
+    uint64_t restore_page(PageNumber vpn, FrameNumber pfn);
+    bool writeback_compressed();
+    std::optional<PageNumber> next_huge_candidate();
+    CollapseResult collapse_range(PageNumber base, uint64_t& cycles);
+    void split_huge_page(PageNumber vpn);
+    void discard_evicted(PageNumber start, PageNumber end);
+    uint64_t scaled_cycles(size_t cycles_per_kb, size_t bytes) const;
 };
 
 } // namespace vm
@@ -0,0 +1,222 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "Config.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vm {
+
+class VirtualMemoryManager;
+
+struct MemoryAccess {
+    VirtualAddress address;
+    bool write;
+};
+
+struct WorkloadRegion {
+    VirtualAddress base;
+    size_t length;
+};
+
+class RandomLanes {
+public:
+    static constexpr size_t kLanes = 4;
+
+    explicit RandomLanes(uint64_t seed = 0);
+
+    void seed(uint64_t seed);
+    uint64_t next();
+    void fill(uint64_t* out, size_t count);
+    double next_double() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+private:
+    uint64_t state_[4][kLanes];
+    uint64_t buffer_[kLanes];
+    size_t buffered_;
+
+    void step(uint64_t* out);
+};
+
+inline uint64_t bounded_random(uint64_t r, uint64_t bound) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128;
+    return static_cast<uint64_t>((static_cast<uint128>(r) * bound) >> 64);
+#else
+    return static_cast<uint64_t>(static_cast<double>(r >> 11) * 0x1.0p-53 * static_cast<double>(bound));
+#endif
+}
+
+class WorkloadGenerator {
+public:
+    static constexpr size_t kChunkSize = 256;
+
+    WorkloadGenerator(WorkloadRegion region, double write_ratio, uint64_t seed);
+    virtual ~WorkloadGenerator() = default;
+
+    virtual size_t generate(MemoryAccess* out, size_t count) = 0;
+    virtual void reset();
+    virtual void footprint(std::vector<WorkloadRegion>& regions) const;
+
+    const WorkloadRegion& get_region() const { return region_; }
+    uint64_t get_seed() const { return seed_; }
+
+protected:
+    WorkloadRegion region_;
+    uint32_t write_threshold_;
+    uint64_t seed_;
+    RandomLanes rng_;
+
+    bool is_write(uint64_t r) const { return (r & 0xFFFF) < write_threshold_; }
+};
+
+class StridedWorkload : public WorkloadGenerator {
+public:
+    StridedWorkload(WorkloadRegion region, size_t stride, double write_ratio = 0.0, uint64_t seed = 1);
+
+    size_t generate(MemoryAccess* out, size_t count) override;
+    void reset() override;
+
+private:
+    size_t stride_;
+    size_t position_;
+};
+
+class SequentialWorkload : public StridedWorkload {
+public:
+    SequentialWorkload(WorkloadRegion region, size_t access_size = 8,
+                       double write_ratio = 0.0, uint64_t seed = 1)
+        : StridedWorkload(region, access_size, write_ratio, seed) {}
+};
+
+class UniformWorkload : public WorkloadGenerator {
+public:
+    UniformWorkload(WorkloadRegion region, double write_ratio = 0.0, uint64_t seed = 1);
+
+    size_t generate(MemoryAccess* out, size_t count) override;
+};
+
+class ZipfianWorkload : public WorkloadGenerator {
+public:
+    ZipfianWorkload(WorkloadRegion region, size_t page_size, double theta = 0.99,
+                    double write_ratio = 0.0, uint64_t seed = 1, bool scramble = true);
+
+    size_t generate(MemoryAccess* out, size_t count) override;
+
+    // Regions up to this many pages sample from a precomputed alias table;
+    // larger ones fall back to rejection-inversion, one sample at a time.
+    static constexpr uint64_t kMaxAliasPages = 1ULL << 20;
+
+private:
+    size_t page_size_;
+    uint64_t num_pages_;
+    double theta_;
+    bool scramble_;
+    uint64_t permute_mask_;
+    double h_integral_x1_;
+    double h_integral_n_;
+    double s_;
+
+    // Indexed by page, already scrambled: a uniform page keeps itself when
+    // the low 32 bits of its random word fall below alias_threshold_, and
+    // otherwise becomes alias_page_.
+    std::vector<uint32_t> alias_threshold_;
+    std::vector<uint32_t> alias_page_;
+
+    void build_alias_table();
+    uint64_t sample_rank();
+    uint64_t permute(uint64_t index) const;
+    double h(double x) const;
+    double h_integral(double x) const;
+    double h_integral_inverse(double x) const;
+};
+
+class HotColdWorkload : public WorkloadGenerator {
+public:
+    HotColdWorkload(WorkloadRegion region, size_t page_size, double hot_fraction = 0.1,
+                    double hot_probability = 0.9, double write_ratio = 0.0, uint64_t seed = 1);
+
+    size_t generate(MemoryAccess* out, size_t count) override;
+
+private:
+    size_t page_size_;
+    uint64_t hot_bytes_;
+    uint64_t cold_bytes_;
+    uint64_t hot_threshold_;
+};
+
+class PointerChaseWorkload : public WorkloadGenerator {
+public:
+    PointerChaseWorkload(WorkloadRegion region, size_t node_size = 64,
+                         double write_ratio = 0.0, uint64_t seed = 1);
+
+    size_t generate(MemoryAccess* out, size_t count) override;
+    void reset() override;
+
+private:
+    size_t node_size_;
+    uint64_t num_nodes_;
+    uint64_t mask_;
+    uint64_t multiplier_;
+    uint64_t increment_;
+    uint64_t current_;
+};
+
+class PhaseWorkload : public WorkloadGenerator {
+public:
+    struct Phase {
+        std::unique_ptr<WorkloadGenerator> generator;
+        size_t length;
+    };
+
+    explicit PhaseWorkload(std::vector<Phase> phases);
+
+    size_t generate(MemoryAccess* out, size_t count) override;
+    void reset() override;
+    void footprint(std::vector<WorkloadRegion>& regions) const override;
+
+    size_t get_current_phase() const { return current_phase_; }
+
+private:
+    std::vector<Phase> phases_;
+    size_t current_phase_;
+    size_t phase_position_;
+};
+
+class MixWorkload : public WorkloadGenerator {
+public:
+    struct Component {
+        std::unique_ptr<WorkloadGenerator> generator;
+        double weight;
+    };
+
+    MixWorkload(std::vector<Component> components, uint64_t seed = 1);
+
+    size_t generate(MemoryAccess* out, size_t count) override;
+    void reset() override;
+    void footprint(std::vector<WorkloadRegion>& regions) const override;
+
+private:
+    std::vector<Component> components_;
+    std::vector<uint64_t> thresholds_;
+    std::vector<std::vector<MemoryAccess>> buffers_;
+};
+
+struct WorkloadRunStats {
+    size_t accesses;
+    size_t reads;
+    size_t writes;
+    size_t failed;
+
+    WorkloadRunStats() : accesses(0), reads(0), writes(0), failed(0) {}
+};
+
+void map_workload_footprint(VirtualMemoryManager& vmm, const WorkloadGenerator& generator);
+WorkloadRunStats run_workload(VirtualMemoryManager& vmm, WorkloadGenerator& generator,
+                              size_t count, bool map_footprint = true);
+
+} // namespace vm
+
+#endif // WORKLOAD_H
@@ -0,0 +1,78 @@
+#include "BackgroundWorker.h"
+
+namespace vm {
+
+BackgroundWorker::BackgroundWorker(WorkFn work, std::chrono::milliseconds poll_interval)
+    : work_(std::move(work)),
+      poll_interval_(poll_interval),
+      running_(false),
+      stop_requested_(false),
+      wake_pending_(false),
+      wakeups_(0),
+      runs_(0),
+      items_processed_(0) {}
+
+BackgroundWorker::~BackgroundWorker() {
+    stop();
+}
+
+void BackgroundWorker::start() {
+    if (running_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_requested_ = false;
+        wake_pending_ = false;
+    }
+    running_ = true;
+    thread_ = std::thread(&BackgroundWorker::run, this);
+}
+
+void BackgroundWorker::stop() {
+    if (!running_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_requested_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    running_ = false;
+}
+
+void BackgroundWorker::wake() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (wake_pending_) {
+            return;
+        }
+        wake_pending_ = true;
+    }
+    wakeups_.fetch_add(1, std::memory_order_relaxed);
+    cv_.notify_one();
+}
+
+void BackgroundWorker::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_requested_) {
+        cv_.wait_for(lock, poll_interval_, [this] { return stop_requested_ || wake_pending_; });
+        if (stop_requested_) {
+            break;
+        }
+
+        // A timeout runs the work too, as a periodic check like kswapd's, so
+        // the work function must be cheap when there is nothing to do.
+        // Consume any wakeup before running, so a wake() that arrives while
+        // work_() is busy schedules another pass instead of being dropped.
+        wake_pending_ = false;
+        lock.unlock();
+        size_t processed = work_();
+        runs_.fetch_add(1, std::memory_order_relaxed);
+        items_processed_.fetch_add(processed, std::memory_order_relaxed);
+        lock.lock();
+    }
+}
+
+} // namespace vm
@@ -0,0 +1,204 @@
+#include "CacheHierarchy.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace vm {
+
+namespace {
+
+size_t log2_exact(size_t value) {
+    size_t shift = 0;
+    while ((1ULL << shift) < value) {
+        shift++;
+    }
+    return shift;
+}
+
+} // namespace
+
+Cache::Cache(const CacheLevelConfig& config, std::shared_ptr<MetricsRegistry> metrics)
+    : config_(config),
+      num_sets_(0),
+      ways_(config.associativity),
+      clock_(0),
+      rng_state_(0x9E3779B97F4A7C15ULL),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()) {
+
+    if (config.line_size == 0 || ways_ == 0 || config.size_bytes < config.line_size * ways_) {
+        throw std::invalid_argument("Invalid cache geometry for " + config.name);
+    }
+    num_sets_ = config.size_bytes / (config.line_size * ways_);
+    if ((num_sets_ & (num_sets_ - 1)) != 0) {
+        throw std::invalid_argument("Cache set count must be a power of two for " + config.name);
+    }
+
+    tags_.assign(num_sets_ * ways_, 0);
+    flags_.assign(num_sets_ * ways_, 0);
+    ages_.assign(num_sets_ * ways_, 0);
+
+    accesses_ = metrics_->counter(config.name + "_accesses", "Cache lookups");
+    misses_ = metrics_->counter(config.name + "_misses", "Cache lookups that missed");
+    writebacks_ = metrics_->counter(config.name + "_writebacks", "Dirty lines written back from this level");
+}
+
+bool Cache::lookup(uint64_t line, bool write) {
+    accesses_.inc();
+
+    size_t base = (line & (num_sets_ - 1)) * ways_;
+    for (size_t way = base; way < base + ways_; ++way) {
+        if ((flags_[way] & kValid) && tags_[way] == line) {
+            if (write) {
+                flags_[way] |= kDirty;
+            }
+            ages_[way] = config_.replacement == CacheReplacement::Srrip ? 0 : ++clock_;
+            return true;
+        }
+    }
+
+    misses_.inc();
+    return false;
+}
+
+std::optional<uint64_t> Cache::fill(uint64_t line, bool dirty) {
+    size_t base = (line & (num_sets_ - 1)) * ways_;
+    size_t way = select_victim(base);
+
+    std::optional<uint64_t> victim;
+    if ((flags_[way] & (kValid | kDirty)) == (kValid | kDirty)) {
+        victim = tags_[way];
+        writebacks_.inc();
+    }
+
+    tags_[way] = line;
+    flags_[way] = kValid | (dirty ? kDirty : 0);
+    ages_[way] = config_.replacement == CacheReplacement::Srrip ? kMaxRrpv - 1 : ++clock_;
+    return victim;
+}
+
+std::optional<uint64_t> Cache::absorb_writeback(uint64_t line) {
+    size_t base = (line & (num_sets_ - 1)) * ways_;
+    for (size_t way = base; way < base + ways_; ++way) {
+        if ((flags_[way] & kValid) && tags_[way] == line) {
+            flags_[way] |= kDirty;
+            return std::nullopt;
+        }
+    }
+    return fill(line, true);
+}
+
+void Cache::invalidate_all() {
+    std::fill(flags_.begin(), flags_.end(), 0);
+}
+
+size_t Cache::select_victim(size_t base) {
+    for (size_t way = base; way < base + ways_; ++way) {
+        if (!(flags_[way] & kValid)) {
+            return way;
+        }
+    }
+
+    switch (config_.replacement) {
+    case CacheReplacement::Random:
+        rng_state_ ^= rng_state_ << 13;
+        rng_state_ ^= rng_state_ >> 7;
+        rng_state_ ^= rng_state_ << 17;
+        return base + rng_state_ % ways_;
+    case CacheReplacement::Srrip:
+        while (true) {
+            for (size_t way = base; way < base + ways_; ++way) {
+                if (ages_[way] >= kMaxRrpv) {
+                    return way;
+                }
+            }
+            for (size_t way = base; way < base + ways_; ++way) {
+                ages_[way]++;
+            }
+        }
+    case CacheReplacement::Lru:
+        break;
+    }
+
+    size_t victim = base;
+    for (size_t way = base + 1; way < base + ways_; ++way) {
+        if (ages_[way] < ages_[victim]) {
+            victim = way;
+        }
+    }
+    return victim;
+}
+
+CacheHierarchy::CacheHierarchy(const std::vector<CacheLevelConfig>& levels, size_t memory_cycles,
+                               std::shared_ptr<MetricsRegistry> metrics)
+    : line_shift_(0),
+      memory_cycles_(memory_cycles),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()) {
+
+    if (levels.empty()) {
+        throw std::invalid_argument("Cache hierarchy needs at least one level");
+    }
+    for (const auto& level : levels) {
+        if (level.line_size != levels.front().line_size) {
+            throw std::invalid_argument("All cache levels must share a line size");
+        }
+        levels_.push_back(std::make_unique<Cache>(level, metrics_));
+    }
+    line_shift_ = log2_exact(levels.front().line_size);
+
+    memory_reads_ = metrics_->counter("cache_memory_reads", "Lines fetched from memory");
+    memory_writes_ = metrics_->counter("cache_memory_writes", "Dirty lines written back to memory");
+}
+
+std::vector<CacheLevelConfig> CacheHierarchy::levels_from_config(const Config& config) {
+    return {
+        {"cache_l1", config.l1_cache_size, config.cache_line_size, config.l1_associativity,
+         config.l1_hit_cycles, config.cache_replacement},
+        {"cache_l2", config.l2_cache_size, config.cache_line_size, config.l2_associativity,
+         config.l2_hit_cycles, config.cache_replacement},
+        {"cache_llc", config.llc_size, config.cache_line_size, config.llc_associativity,
+         config.llc_hit_cycles, config.cache_replacement},
+    };
+}
+
+uint64_t CacheHierarchy::access(PhysicalAddress paddr, bool write) {
+    return access_level(0, paddr >> line_shift_, write);
+}
+
+void CacheHierarchy::invalidate_all() {
+    for (auto& level : levels_) {
+        level->invalidate_all();
+    }
+}
+
+uint64_t CacheHierarchy::access_level(size_t level, uint64_t line, bool write) {
+    if (level == levels_.size()) {
+        memory_reads_.inc();
+        return memory_cycles_;
+    }
+
+    Cache& cache = *levels_[level];
+    uint64_t cycles = cache.get_hit_cycles();
+    if (cache.lookup(line, write)) {
+        return cycles;
+    }
+
+    cycles += access_level(level + 1, line, false);
+    auto victim = cache.fill(line, write);
+    if (victim.has_value()) {
+        write_back(level + 1, victim.value());
+    }
+    return cycles;
+}
+
+void CacheHierarchy::write_back(size_t level, uint64_t line) {
+    if (level == levels_.size()) {
+        memory_writes_.inc();
+        return;
+    }
+
+    auto victim = levels_[level]->absorb_writeback(line);
+    if (victim.has_value()) {
+        write_back(level + 1, victim.value());
+    }
+}
+
+} // namespace vm
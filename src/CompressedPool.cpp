@@ -0,0 +1,273 @@
+#include "CompressedPool.h"
+#include "Compression.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace vm {
+
+namespace {
+
+constexpr unsigned kClassShift = 48;
+constexpr unsigned kSlabShift = 16;
+constexpr uint64_t kSlotMask = 0xFFFF;
+constexpr uint64_t kSlabMask = 0xFFFFFFFF;
+
+CompressedHandle make_handle(size_t size_class, size_t slab, size_t slot) {
+    return (static_cast<uint64_t>(size_class) << kClassShift) |
+           (static_cast<uint64_t>(slab) << kSlabShift) |
+           static_cast<uint64_t>(slot);
+}
+
+} // namespace
+
+CompressedPool::CompressedPool(PhysicalMemory& memory, size_t capacity_bytes,
+                               std::shared_ptr<MetricsRegistry> metrics)
+    : memory_(memory),
+      page_size_(memory.get_page_size()),
+      capacity_pages_(page_size_ > 0 ? std::min(capacity_bytes / page_size_, memory.get_num_frames()) : 0),
+      class_granularity_(std::max<size_t>(page_size_ / 64, 8)),
+      max_compressed_size_(page_size_ * 3 / 4),
+      used_pages_(0),
+      stored_pages_(0),
+      compressed_bytes_(0),
+      scratch_(lz4_compress_bound(page_size_)),
+      gather_(page_size_),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()) {
+
+    if (page_size_ == 0 || page_size_ > 65535) {
+        throw std::invalid_argument("Compressed pool needs a page size below 64 KB");
+    }
+
+    size_t num_classes = (max_compressed_size_ + class_granularity_ - 1) / class_granularity_;
+    classes_.resize(num_classes);
+    for (size_t i = 0; i < num_classes; ++i) {
+        SizeClass& size_class = classes_[i];
+        size_class.object_size = (i + 1) * class_granularity_;
+
+        size_t best_waste = page_size_ * kMaxPagesPerSlab;
+        for (size_t pages = 1; pages <= kMaxPagesPerSlab; ++pages) {
+            size_t bytes = pages * page_size_;
+            size_t waste = (bytes % size_class.object_size) * kMaxPagesPerSlab / pages;
+            if (waste < best_waste) {
+                best_waste = waste;
+                size_class.pages_per_slab = pages;
+            }
+        }
+        size_class.objects_per_slab = size_class.pages_per_slab * page_size_ / size_class.object_size;
+    }
+
+    stores_ = metrics_->counter("compressed_pool_stores", "Pages compressed into the pool");
+    loads_ = metrics_->counter("compressed_pool_loads", "Pages decompressed from the pool");
+    rejected_incompressible_ = metrics_->counter("compressed_pool_rejected_incompressible",
+                                                 "Pages that did not compress below the size limit");
+    rejected_full_ = metrics_->counter("compressed_pool_rejected_full",
+                                       "Pages rejected because the pool was full or out of frames");
+    writebacks_ = metrics_->counter("compressed_pool_writebacks",
+                                    "Compressed pages written back to swap to make room");
+    stored_pages_gauge_ = metrics_->gauge("compressed_pool_stored_pages", "Pages held in the pool");
+    compressed_bytes_gauge_ = metrics_->gauge("compressed_pool_compressed_bytes",
+                                              "Compressed payload bytes held in the pool");
+    pool_pages_gauge_ = metrics_->gauge("compressed_pool_pages", "Frames of RAM backing the pool");
+    compressed_size_ = metrics_->histogram("compressed_pool_object_bytes", "Compressed page sizes");
+}
+
+std::optional<CompressedHandle> CompressedPool::store(const uint8_t* page) {
+    if (!is_enabled()) {
+        return std::nullopt;
+    }
+
+    size_t size = lz4_compress(page, page_size_, scratch_.data(), scratch_.size());
+    if (size == 0 || size > max_compressed_size_) {
+        rejected_incompressible_.inc();
+        return std::nullopt;
+    }
+
+    size_t class_index = (size - 1) / class_granularity_;
+    SizeClass& size_class = classes_[class_index];
+
+    // A full pool makes room by writing its oldest pages back to swap. Running
+    // out of free frames is not the pool's to fix, so that case just rejects.
+    size_t writebacks = 0;
+    while (size_class.partial_slabs.empty() && !allocate_slab(size_class).has_value()) {
+        bool at_capacity = used_pages_ + size_class.pages_per_slab > capacity_pages_;
+        if (!at_capacity || !writeback_ || writebacks == kMaxWritebacksPerStore || !writeback_()) {
+            rejected_full_.inc();
+            return std::nullopt;
+        }
+        writebacks++;
+        writebacks_.inc();
+    }
+
+    uint32_t slab_id = size_class.partial_slabs.back();
+    Slab& slab = *size_class.slabs[slab_id];
+    uint16_t slot = slab.free_slots.back();
+    slab.free_slots.pop_back();
+    if (slab.free_slots.empty()) {
+        size_class.partial_slabs.pop_back();
+        slab.in_partial_list = false;
+    }
+
+    copy_to_slab(slab, slot * size_class.object_size, scratch_.data(), size);
+    slab.lengths[slot] = static_cast<uint16_t>(size);
+
+    stored_pages_++;
+    compressed_bytes_ += size;
+    stores_.inc();
+    compressed_size_.record(size);
+    stored_pages_gauge_.add(1);
+    compressed_bytes_gauge_.add(static_cast<int64_t>(size));
+
+    return make_handle(class_index, slab_id, slot);
+}
+
+size_t CompressedPool::load(CompressedHandle handle, uint8_t* page) {
+    SizeClass* size_class;
+    size_t slot;
+    Slab* slab = slab_for(handle, size_class, slot);
+
+    size_t size = slab->lengths[slot];
+    copy_from_slab(*slab, slot * size_class->object_size, gather_.data(), size);
+    size_t decompressed = lz4_decompress(gather_.data(), size, page, page_size_);
+    if (decompressed != page_size_) {
+        throw std::runtime_error("Compressed page decompressed to the wrong size");
+    }
+
+    loads_.inc();
+    return size;
+}
+
+void CompressedPool::release(CompressedHandle handle) {
+    SizeClass* size_class;
+    size_t slot;
+    Slab* slab = slab_for(handle, size_class, slot);
+    uint32_t slab_id = static_cast<uint32_t>((handle >> kSlabShift) & kSlabMask);
+
+    size_t size = slab->lengths[slot];
+    slab->lengths[slot] = 0;
+    slab->free_slots.push_back(static_cast<uint16_t>(slot));
+
+    stored_pages_--;
+    compressed_bytes_ -= size;
+    stored_pages_gauge_.add(-1);
+    compressed_bytes_gauge_.add(-static_cast<int64_t>(size));
+
+    if (slab->free_slots.size() == size_class->objects_per_slab) {
+        if (slab->in_partial_list) {
+            auto& partial = size_class->partial_slabs;
+            partial.erase(std::find(partial.begin(), partial.end(), slab_id));
+        }
+        free_slab(*size_class, slab_id);
+    } else if (!slab->in_partial_list) {
+        size_class->partial_slabs.push_back(slab_id);
+        slab->in_partial_list = true;
+    }
+}
+
+size_t CompressedPool::get_compressed_size(CompressedHandle handle) const {
+    SizeClass* size_class;
+    size_t slot;
+    return slab_for(handle, size_class, slot)->lengths[slot];
+}
+
+double CompressedPool::get_compression_ratio() const {
+    if (used_pages_ == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(stored_pages_) / static_cast<double>(used_pages_);
+}
+
+double CompressedPool::get_occupancy() const {
+    if (capacity_pages_ == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(used_pages_) / static_cast<double>(capacity_pages_);
+}
+
+CompressedPool::Slab* CompressedPool::slab_for(CompressedHandle handle, SizeClass*& size_class,
+                                               size_t& slot) const {
+    size_t class_index = static_cast<size_t>(handle >> kClassShift);
+    size_t slab_id = static_cast<size_t>((handle >> kSlabShift) & kSlabMask);
+    slot = static_cast<size_t>(handle & kSlotMask);
+
+    if (class_index >= classes_.size()) {
+        throw std::out_of_range("Invalid compressed handle");
+    }
+    size_class = const_cast<SizeClass*>(&classes_[class_index]);
+    if (slab_id >= size_class->slabs.size() || !size_class->slabs[slab_id] ||
+        slot >= size_class->objects_per_slab || size_class->slabs[slab_id]->lengths[slot] == 0) {
+        throw std::out_of_range("Invalid compressed handle");
+    }
+    return size_class->slabs[slab_id].get();
+}
+
+std::optional<uint32_t> CompressedPool::allocate_slab(SizeClass& size_class) {
+    if (used_pages_ + size_class.pages_per_slab > capacity_pages_ ||
+        memory_.get_free_frames() < size_class.pages_per_slab) {
+        return std::nullopt;
+    }
+
+    auto slab = std::make_unique<Slab>();
+    for (size_t i = 0; i < size_class.pages_per_slab; ++i) {
+        FrameNumber pfn = memory_.allocate_frame(0).value();
+        memory_.pin_frame(pfn);
+        slab->frames.push_back(pfn);
+    }
+    slab->lengths.assign(size_class.objects_per_slab, 0);
+    slab->free_slots.reserve(size_class.objects_per_slab);
+    for (size_t i = size_class.objects_per_slab; i > 0; --i) {
+        slab->free_slots.push_back(static_cast<uint16_t>(i - 1));
+    }
+    slab->in_partial_list = true;
+
+    uint32_t slab_id;
+    if (!size_class.free_slab_ids.empty()) {
+        slab_id = size_class.free_slab_ids.back();
+        size_class.free_slab_ids.pop_back();
+        size_class.slabs[slab_id] = std::move(slab);
+    } else {
+        slab_id = static_cast<uint32_t>(size_class.slabs.size());
+        size_class.slabs.push_back(std::move(slab));
+    }
+    size_class.partial_slabs.push_back(slab_id);
+
+    used_pages_ += size_class.pages_per_slab;
+    pool_pages_gauge_.add(static_cast<int64_t>(size_class.pages_per_slab));
+    return slab_id;
+}
+
+void CompressedPool::free_slab(SizeClass& size_class, uint32_t slab_id) {
+    for (FrameNumber pfn : size_class.slabs[slab_id]->frames) {
+        memory_.free_frame(pfn);
+    }
+    size_class.slabs[slab_id].reset();
+    size_class.free_slab_ids.push_back(slab_id);
+    used_pages_ -= size_class.pages_per_slab;
+    pool_pages_gauge_.add(-static_cast<int64_t>(size_class.pages_per_slab));
+}
+
+// Slab frames need not be physically contiguous, so an object may straddle
+// two of them, as in zsmalloc.
+void CompressedPool::copy_to_slab(const Slab& slab, size_t offset, const uint8_t* src, size_t size) {
+    while (size > 0) {
+        size_t in_page = offset % page_size_;
+        size_t chunk = std::min(size, page_size_ - in_page);
+        std::memcpy(memory_.get_frame_data(slab.frames[offset / page_size_]) + in_page, src, chunk);
+        offset += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+}
+
+void CompressedPool::copy_from_slab(const Slab& slab, size_t offset, uint8_t* dst, size_t size) {
+    while (size > 0) {
+        size_t in_page = offset % page_size_;
+        size_t chunk = std::min(size, page_size_ - in_page);
+        std::memcpy(dst, memory_.get_frame_data(slab.frames[offset / page_size_]) + in_page, chunk);
+        offset += chunk;
+        dst += chunk;
+        size -= chunk;
+    }
+}
+
+} // namespace vm
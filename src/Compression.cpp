@@ -0,0 +1,200 @@
+#include "Compression.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace vm {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;
+constexpr size_t kMatchFindLimit = 12;
+constexpr size_t kHashBits = 12;
+constexpr size_t kMaxOffset = 65535;
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash_sequence(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - kHashBits);
+}
+
+class BlockWriter {
+public:
+    BlockWriter(uint8_t* dst, size_t capacity) : dst_(dst), capacity_(capacity), pos_(0), ok_(true) {}
+
+    void byte(uint8_t b) {
+        if (pos_ >= capacity_) {
+            ok_ = false;
+            return;
+        }
+        dst_[pos_++] = b;
+    }
+
+    void bytes(const uint8_t* src, size_t n) {
+        if (n > capacity_ - pos_) {
+            ok_ = false;
+            return;
+        }
+        std::memcpy(dst_ + pos_, src, n);
+        pos_ += n;
+    }
+
+    void length_extension(size_t extra) {
+        while (extra >= 255) {
+            byte(255);
+            extra -= 255;
+        }
+        byte(static_cast<uint8_t>(extra));
+    }
+
+    void sequence(const uint8_t* literals, size_t literal_length, size_t offset, size_t match_length) {
+        size_t match_code = match_length >= kMinMatch ? match_length - kMinMatch : 0;
+        uint8_t token = static_cast<uint8_t>(((literal_length < 15 ? literal_length : 15) << 4) |
+                                             (match_code < 15 ? match_code : 15));
+        byte(token);
+        if (literal_length >= 15) {
+            length_extension(literal_length - 15);
+        }
+        bytes(literals, literal_length);
+
+        if (match_length == 0) {
+            return;
+        }
+        byte(static_cast<uint8_t>(offset & 0xFF));
+        byte(static_cast<uint8_t>(offset >> 8));
+        if (match_code >= 15) {
+            length_extension(match_code - 15);
+        }
+    }
+
+    bool ok() const { return ok_; }
+    size_t size() const { return pos_; }
+
+private:
+    uint8_t* dst_;
+    size_t capacity_;
+    size_t pos_;
+    bool ok_;
+};
+
+} // namespace
+
+size_t lz4_compress_bound(size_t input_size) {
+    return input_size + input_size / 255 + 16;
+}
+
+size_t lz4_compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity) {
+    BlockWriter out(dst, dst_capacity);
+
+    size_t anchor = 0;
+    if (src_size > kMatchFindLimit) {
+        int32_t table[1 << kHashBits];
+        for (auto& slot : table) {
+            slot = -1;
+        }
+
+        size_t match_limit = src_size - kMatchFindLimit;
+        size_t ip = 0;
+        size_t misses = 0;
+
+        while (ip < match_limit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t h = hash_sequence(sequence);
+            int32_t candidate = table[h];
+            table[h] = static_cast<int32_t>(ip);
+
+            if (candidate < 0 || ip - static_cast<size_t>(candidate) > kMaxOffset ||
+                read32(src + candidate) != sequence) {
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            size_t ref = static_cast<size_t>(candidate);
+            size_t match_length = kMinMatch;
+            size_t max_match = src_size - kLastLiterals - ip;
+            while (match_length < max_match && src[ref + match_length] == src[ip + match_length]) {
+                match_length++;
+            }
+
+            out.sequence(src + anchor, ip - anchor, ip - ref, match_length);
+            if (!out.ok()) {
+                return 0;
+            }
+
+            ip += match_length;
+            anchor = ip;
+        }
+    }
+
+    out.sequence(src + anchor, src_size - anchor, 0, 0);
+    return out.ok() ? out.size() : 0;
+}
+
+size_t lz4_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity) {
+    size_t ip = 0;
+    size_t op = 0;
+
+    auto read_length = [&](size_t length) {
+        if (length != 15) {
+            return length;
+        }
+        uint8_t b;
+        do {
+            if (ip >= src_size) {
+                throw std::runtime_error("Truncated LZ4 block");
+            }
+            b = src[ip++];
+            length += b;
+        } while (b == 255);
+        return length;
+    };
+
+    while (ip < src_size) {
+        uint8_t token = src[ip++];
+
+        size_t literal_length = read_length(token >> 4);
+        if (literal_length > src_size - ip || literal_length > dst_capacity - op) {
+            throw std::runtime_error("LZ4 literal run out of bounds");
+        }
+        std::memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        if (ip == src_size) {
+            break;
+        }
+
+        if (src_size - ip < 2) {
+            throw std::runtime_error("Truncated LZ4 match offset");
+        }
+        size_t offset = static_cast<size_t>(src[ip]) | (static_cast<size_t>(src[ip + 1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            throw std::runtime_error("Invalid LZ4 match offset");
+        }
+
+        size_t match_length = read_length(token & 0x0F) + kMinMatch;
+        if (match_length > dst_capacity - op) {
+            throw std::runtime_error("LZ4 match out of bounds");
+        }
+
+        size_t match = op - offset;
+        if (offset >= match_length) {
+            std::memcpy(dst + op, dst + match, match_length);
+            op += match_length;
+        } else {
+            for (size_t i = 0; i < match_length; ++i) {
+                dst[op++] = dst[match + i];
+            }
+        }
+    }
+
+    return op;
+}
+
+} // namespace vm
@@ -0,0 +1,156 @@
+#include "ConcurrentPageTable.h"
+#include <thread>
+
+namespace vm {
+
+ConcurrentPageTable::Node::Node(size_t size, bool leaf) {
+    if (leaf) {
+        entries = std::make_unique<std::atomic<uint64_t>[]>(size);
+        for (size_t i = 0; i < size; ++i) {
+            entries[i].store(0, std::memory_order_relaxed);
+        }
+    } else {
+        children = std::make_unique<std::atomic<Node*>[]>(size);
+        for (size_t i = 0; i < size; ++i) {
+            children[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+}
+
+ConcurrentPageTable::ConcurrentPageTable(const Config& config)
+    : num_levels_(config.page_table_levels),
+      bits_per_level_(config.bits_per_level),
+      entries_per_level_(1ULL << config.bits_per_level),
+      num_entries_(0),
+      num_nodes_(1),
+      root_(new Node(entries_per_level_, num_levels_ == 1)) {}
+
+ConcurrentPageTable::~ConcurrentPageTable() {
+    release_node(root_, 0);
+}
+
+std::optional<PageTableEntry> ConcurrentPageTable::lookup(PageNumber vpn) const {
+    std::atomic<uint64_t>* slot = walk_page_table(vpn, false);
+    if (!slot) {
+        return std::nullopt;
+    }
+
+    uint64_t word = slot->load(std::memory_order_acquire);
+    if (!(word & kValidBit)) {
+        return std::nullopt;
+    }
+    return decode(word);
+}
+
+// Returns false, leaving the entry untouched, when the page is not mapped or
+// its protection bits do not allow the access.
+bool ConcurrentPageTable::mark_accessed(PageNumber vpn, bool write) {
+    std::atomic<uint64_t>* slot = walk_page_table(vpn, false);
+    if (!slot) {
+        return false;
+    }
+
+    uint64_t required = static_cast<uint64_t>(write ? kProtWrite : kProtRead) << kProtectionShift;
+    uint64_t bits = kReferencedBit | (write ? kDirtyBit : 0);
+    uint64_t word = slot->load(std::memory_order_relaxed);
+    if (!(word & kValidBit) || !(word & required)) {
+        return false;
+    }
+    if ((word & bits) != bits) {
+        slot->fetch_or(bits, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+ClaimResult ConcurrentPageTable::claim(PageNumber vpn, PageTableEntry& existing) {
+    std::atomic<uint64_t>* slot = walk_page_table(vpn, true);
+    uint64_t word = slot->load(std::memory_order_acquire);
+    while (true) {
+        if (word & kValidBit) {
+            existing = decode(word);
+            return ClaimResult::AlreadyMapped;
+        }
+        if (word & kBusyBit) {
+            std::this_thread::yield();
+            word = slot->load(std::memory_order_acquire);
+            continue;
+        }
+        if (slot->compare_exchange_weak(word, kBusyBit, std::memory_order_acquire,
+                                        std::memory_order_acquire)) {
+            return ClaimResult::Claimed;
+        }
+    }
+}
+
+void ConcurrentPageTable::publish(PageNumber vpn, FrameNumber pfn, uint8_t protection) {
+    std::atomic<uint64_t>* slot = walk_page_table(vpn, false);
+    slot->store(encode(pfn, protection) | kReferencedBit, std::memory_order_release);
+    num_entries_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConcurrentPageTable::abandon(PageNumber vpn) {
+    std::atomic<uint64_t>* slot = walk_page_table(vpn, false);
+    slot->store(0, std::memory_order_release);
+}
+
+PageTableEntry ConcurrentPageTable::decode(uint64_t word) {
+    PageTableEntry entry;
+    entry.frame_number = word >> kFrameShift;
+    entry.valid = (word & kValidBit) != 0;
+    entry.dirty = (word & kDirtyBit) != 0;
+    entry.referenced = (word & kReferencedBit) != 0;
+    entry.protection = static_cast<uint8_t>((word >> kProtectionShift) & 0xFF);
+    return entry;
+}
+
+uint64_t ConcurrentPageTable::encode(FrameNumber pfn, uint8_t protection) {
+    return (pfn << kFrameShift) | (static_cast<uint64_t>(protection) << kProtectionShift) | kValidBit;
+}
+
+size_t ConcurrentPageTable::extract_level_index(PageNumber vpn, size_t level) const {
+    size_t shift = (num_levels_ - 1 - level) * bits_per_level_;
+    size_t mask = (1ULL << bits_per_level_) - 1;
+    return (vpn >> shift) & mask;
+}
+
+std::atomic<uint64_t>* ConcurrentPageTable::walk_page_table(PageNumber vpn, bool create) const {
+    Node* current = root_;
+
+    for (size_t level = 0; level + 1 < num_levels_; ++level) {
+        std::atomic<Node*>& link = current->children[extract_level_index(vpn, level)];
+        Node* child = link.load(std::memory_order_acquire);
+
+        if (!child) {
+            if (!create) {
+                return nullptr;
+            }
+            bool is_last_level = (level == num_levels_ - 2);
+            Node* fresh = new Node(entries_per_level_, is_last_level);
+            if (link.compare_exchange_strong(child, fresh, std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+                child = fresh;
+                num_nodes_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                delete fresh;
+            }
+        }
+
+        current = child;
+    }
+
+    return &current->entries[extract_level_index(vpn, num_levels_ - 1)];
+}
+
+void ConcurrentPageTable::release_node(Node* node, size_t level) {
+    if (level + 1 < num_levels_) {
+        for (size_t i = 0; i < entries_per_level_; ++i) {
+            Node* child = node->children[i].load(std::memory_order_relaxed);
+            if (child) {
+                release_node(child, level + 1);
+            }
+        }
+    }
+    delete node;
+}
+
+} // namespace vm
@@ -0,0 +1,505 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace vm {
+
+namespace {
+
+std::atomic<uint64_t> next_registry_id{1};
+
+bool is_valid_metric_name(const std::string& name) {
+    if (name.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        char c = name[i];
+        bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        bool digit = c >= '0' && c <= '9';
+        if (!alpha && !(digit && i > 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string escape_json(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+} // namespace
+
+uint64_t Histogram::bucket_lower_bound(size_t index) {
+    if (index < kSubBuckets) {
+        return index;
+    }
+    size_t exponent = index / kSubBuckets + kSubBucketBits - 1;
+    uint64_t sub = index % kSubBuckets;
+    return (kSubBuckets + sub) << (exponent - kSubBucketBits);
+}
+
+uint64_t Histogram::bucket_upper_bound(size_t index) {
+    if (index < kSubBuckets) {
+        return index;
+    }
+    size_t exponent = index / kSubBuckets + kSubBucketBits - 1;
+    return bucket_lower_bound(index) + ((1ULL << (exponent - kSubBucketBits)) - 1);
+}
+
+uint64_t Histogram::count() const {
+    return registry_->read_slot(base_ + kCountSlot);
+}
+
+uint64_t Histogram::sum() const {
+    return registry_->read_slot(base_ + kSumSlot);
+}
+
+double Histogram::mean() const {
+    std::vector<uint64_t> totals;
+    registry_->read_slots(base_ + kCountSlot, 2, totals);
+    return totals[0] > 0 ? static_cast<double>(totals[1]) / totals[0] : 0.0;
+}
+
+uint64_t Histogram::percentile(double q) const {
+    std::vector<uint64_t> buckets;
+    registry_->read_slots(base_, kNumBuckets, buckets);
+
+    uint64_t total = 0;
+    for (uint64_t b : buckets) {
+        total += b;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t lowest = min();
+    uint64_t highest = max();
+    q = std::min(std::max(q, 0.0), 1.0);
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total));
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(std::max(bucket_upper_bound(i), lowest), highest);
+        }
+    }
+    return highest;
+}
+
+uint64_t Histogram::min() const {
+    uint64_t complement = registry_->read_slot_max(base_ + kMinSlot);
+    return complement != 0 ? ~complement : 0;
+}
+
+uint64_t Histogram::max() const {
+    return registry_->read_slot_max(base_ + kMaxSlot);
+}
+
+void Histogram::reset() const {
+    registry_->reset_slots(base_, kMaxSlot);
+    registry_->clear_slots(base_ + kMaxSlot, kNumSlots - kMaxSlot);
+}
+
+MetricsRegistry::MetricsRegistry()
+    : id_(next_registry_id.fetch_add(1)),
+      gauges_(new std::atomic<int64_t>[kMaxGauges]),
+      next_slot_(0),
+      next_gauge_(0) {
+
+    for (size_t i = 0; i < kMaxGauges; ++i) {
+        gauges_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+MetricsRegistry::~MetricsRegistry() = default;
+
+Counter MetricsRegistry::counter(const std::string& name, const std::string& help) {
+    return Counter(this, register_metric(name, help, MetricType::Counter, 1));
+}
+
+Gauge MetricsRegistry::gauge(const std::string& name, const std::string& help) {
+    return Gauge(&gauges_[register_metric(name, help, MetricType::Gauge, 0)]);
+}
+
+Histogram MetricsRegistry::histogram(const std::string& name, const std::string& help) {
+    return Histogram(this, register_metric(name, help, MetricType::Histogram, Histogram::kNumSlots));
+}
+
+bool MetricsRegistry::has_metric(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return metric_index_.count(name) > 0;
+}
+
+// Returns the slot rather than the MetricInfo: metrics_ may reallocate as soon
+// as the lock is dropped, since TLBs register counters from their own threads.
+size_t MetricsRegistry::register_metric(
+    const std::string& name, const std::string& help, MetricType type, size_t slots_needed) {
+
+    if (!is_valid_metric_name(name)) {
+        throw std::invalid_argument("Invalid metric name: " + name);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = metric_index_.find(name);
+    if (it != metric_index_.end()) {
+        const MetricInfo& existing = metrics_[it->second];
+        if (existing.type != type) {
+            throw std::invalid_argument("Metric registered with a different type: " + name);
+        }
+        return existing.slot;
+    }
+
+    MetricInfo info;
+    info.name = name;
+    info.help = help;
+    info.type = type;
+
+    if (type == MetricType::Gauge) {
+        if (next_gauge_ >= kMaxGauges) {
+            throw std::length_error("Too many gauges registered");
+        }
+        info.slot = next_gauge_++;
+    } else {
+        info.slot = next_slot_;
+        next_slot_ += slots_needed;
+        baseline_.resize(next_slot_, 0);
+    }
+
+    metric_index_[name] = metrics_.size();
+    metrics_.push_back(info);
+    return info.slot;
+}
+
+MetricsRegistry::ThreadBlock* MetricsRegistry::attach_thread() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::thread::id tid = std::this_thread::get_id();
+    auto it = thread_blocks_.find(tid);
+    if (it != thread_blocks_.end()) {
+        return it->second;
+    }
+
+    blocks_.push_back(std::make_unique<ThreadBlock>());
+    ThreadBlock* block = blocks_.back().get();
+    thread_blocks_[tid] = block;
+    return block;
+}
+
+void MetricsRegistry::attach_page(ThreadBlock& block, size_t page) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (page >= block.pages.size()) {
+        block.pages.resize(page + 1);
+    }
+    if (!block.pages[page]) {
+        block.pages[page] = std::make_unique<SlotPage>();
+    }
+}
+
+namespace {
+
+template <typename Block>
+std::atomic<uint64_t>* find_slot(const Block& block, size_t slot) {
+    size_t page = slot >> MetricsRegistry::kPageBits;
+    if (page >= block.pages.size() || !block.pages[page]) {
+        return nullptr;
+    }
+    return &block.pages[page]->slots[slot & (MetricsRegistry::kSlotsPerPage - 1)];
+}
+
+} // namespace
+
+uint64_t MetricsRegistry::read_slot_locked(size_t slot) const {
+    uint64_t total = 0;
+    for (const auto& block : blocks_) {
+        if (std::atomic<uint64_t>* s = find_slot(*block, slot)) {
+            total += s->load(std::memory_order_relaxed);
+        }
+    }
+    return total - baseline_[slot];
+}
+
+uint64_t MetricsRegistry::read_slot(size_t slot) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return read_slot_locked(slot);
+}
+
+uint64_t MetricsRegistry::read_slot_max(size_t slot) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t highest = 0;
+    for (const auto& block : blocks_) {
+        if (std::atomic<uint64_t>* s = find_slot(*block, slot)) {
+            highest = std::max(highest, s->load(std::memory_order_relaxed));
+        }
+    }
+    return highest;
+}
+
+void MetricsRegistry::read_slots(size_t first, size_t count, std::vector<uint64_t>& out) const {
+    out.assign(count, 0);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& block : blocks_) {
+        for (size_t i = 0; i < count; ++i) {
+            if (std::atomic<uint64_t>* s = find_slot(*block, first + i)) {
+                out[i] += s->load(std::memory_order_relaxed);
+            }
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        out[i] -= baseline_[first + i];
+    }
+}
+
+void MetricsRegistry::reset_slots(size_t first, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reset_slots_locked(first, count);
+}
+
+void MetricsRegistry::clear_slots(size_t first, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    clear_slots_locked(first, count);
+}
+
+void MetricsRegistry::reset_slots_locked(size_t first, size_t count) {
+    for (size_t slot = first; slot < first + count; ++slot) {
+        uint64_t total = 0;
+        for (const auto& block : blocks_) {
+            if (std::atomic<uint64_t>* s = find_slot(*block, slot)) {
+                total += s->load(std::memory_order_relaxed);
+            }
+        }
+        baseline_[slot] = total;
+    }
+}
+
+// Extrema cannot be rebased like sums, so they are zeroed in every block.
+void MetricsRegistry::clear_slots_locked(size_t first, size_t count) {
+    for (const auto& block : blocks_) {
+        for (size_t slot = first; slot < first + count; ++slot) {
+            if (std::atomic<uint64_t>* s = find_slot(*block, slot)) {
+                s->store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void MetricsRegistry::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& info : metrics_) {
+        if (info.type == MetricType::Counter) {
+            reset_slots_locked(info.slot, 1);
+        } else if (info.type == MetricType::Histogram) {
+            reset_slots_locked(info.slot, Histogram::kMaxSlot);
+            clear_slots_locked(info.slot + Histogram::kMaxSlot,
+                               Histogram::kNumSlots - Histogram::kMaxSlot);
+        }
+    }
+}
+
+size_t MetricsRegistry::get_num_threads() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return blocks_.size();
+}
+
+size_t MetricsRegistry::get_slots_used() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_slot_;
+}
+
+size_t MetricsRegistry::get_bytes_allocated() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t pages = 0;
+    for (const auto& block : blocks_) {
+        for (const auto& page : block->pages) {
+            pages += page ? 1 : 0;
+        }
+    }
+    return pages * sizeof(SlotPage);
+}
+
+void MetricsRegistry::write_prometheus(std::ostream& os, const std::string& prefix) const {
+    std::vector<MetricInfo> metrics;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        metrics = metrics_;
+    }
+
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    for (const auto& info : metrics) {
+        std::string name = prefix + info.name;
+
+        switch (info.type) {
+        case MetricType::Counter:
+            name += "_total";
+            if (!info.help.empty()) {
+                os << "# HELP " << name << " " << info.help << "\n";
+            }
+            os << "# TYPE " << name << " counter\n";
+            os << name << " " << read_slot(info.slot) << "\n";
+            break;
+
+        case MetricType::Gauge:
+            if (!info.help.empty()) {
+                os << "# HELP " << name << " " << info.help << "\n";
+            }
+            os << "# TYPE " << name << " gauge\n";
+            os << name << " " << gauges_[info.slot].load(std::memory_order_relaxed) << "\n";
+            break;
+
+        case MetricType::Histogram: {
+            Histogram h(const_cast<MetricsRegistry*>(this), info.slot);
+            if (!info.help.empty()) {
+                os << "# HELP " << name << " " << info.help << "\n";
+            }
+            os << "# TYPE " << name << " summary\n";
+            for (double q : quantiles) {
+                os << name << "{quantile=\"" << q << "\"} " << h.percentile(q) << "\n";
+            }
+            os << name << "_sum " << h.sum() << "\n";
+            os << name << "_count " << h.count() << "\n";
+            break;
+        }
+        }
+    }
+}
+
+void MetricsRegistry::write_json(std::ostream& os) const {
+    std::vector<MetricInfo> metrics;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        metrics = metrics_;
+    }
+
+    auto write_section = [&](MetricType type, const char* title) {
+        os << "  \"" << title << "\": {";
+        bool first = true;
+        for (const auto& info : metrics) {
+            if (info.type != type) {
+                continue;
+            }
+            os << (first ? "\n" : ",\n");
+            first = false;
+            os << "    \"" << escape_json(info.name) << "\": ";
+
+            if (type == MetricType::Counter) {
+                os << read_slot(info.slot);
+            } else if (type == MetricType::Gauge) {
+                os << gauges_[info.slot].load(std::memory_order_relaxed);
+            } else {
+                // Format the mean locally so the caller's stream keeps its flags.
+                Histogram h(const_cast<MetricsRegistry*>(this), info.slot);
+                std::ostringstream mean;
+                mean << std::fixed << std::setprecision(2) << h.mean();
+                os << "{\"count\": " << h.count()
+                   << ", \"sum\": " << h.sum()
+                   << ", \"mean\": " << mean.str()
+                   << ", \"p50\": " << h.percentile(0.5)
+                   << ", \"p90\": " << h.percentile(0.9)
+                   << ", \"p99\": " << h.percentile(0.99)
+                   << ", \"min\": " << h.min()
+                   << ", \"max\": " << h.max() << "}";
+            }
+        }
+        os << (first ? "}" : "\n  }");
+    };
+
+    os << "{\n";
+    write_section(MetricType::Counter, "counters");
+    os << ",\n";
+    write_section(MetricType::Gauge, "gauges");
+    os << ",\n";
+    write_section(MetricType::Histogram, "histograms");
+    os << "\n}\n";
+}
+
+MetricsExporter::MetricsExporter(const MetricsRegistry& registry, std::string path,
+                                 Format format, std::chrono::milliseconds interval)
+    : registry_(registry),
+      path_(std::move(path)),
+      format_(format),
+      interval_(interval),
+      running_(false),
+      stop_requested_(false),
+      exports_(0) {}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+void MetricsExporter::start() {
+    if (running_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_requested_ = false;
+    }
+    running_ = true;
+    thread_ = std::thread(&MetricsExporter::run, this);
+}
+
+void MetricsExporter::stop() {
+    if (!running_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_requested_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    running_ = false;
+    write_now();
+}
+
+bool MetricsExporter::write_now() const {
+    std::string tmp_path = path_ + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        if (format_ == Format::Prometheus) {
+            registry_.write_prometheus(out);
+        } else {
+            registry_.write_json(out);
+        }
+        if (!out) {
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+        return false;
+    }
+    exports_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void MetricsExporter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_requested_) {
+        lock.unlock();
+        write_now();
+        lock.lock();
+        cv_.wait_for(lock, interval_, [this] { return stop_requested_; });
+    }
+}
+
+} // namespace vm
@@ -0,0 +1,262 @@
+#include "NestedMmu.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace vm {
+
+PageWalkCache::PageWalkCache(size_t levels, size_t bits_per_level, size_t capacity,
+                             std::shared_ptr<MetricsRegistry> metrics, const std::string& name)
+    : levels_(levels),
+      bits_per_level_(bits_per_level),
+      capacity_(capacity),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()) {
+    hits_ = metrics_->counter(name + "_hits", "Walks that skipped upper levels via the walk cache");
+    misses_ = metrics_->counter(name + "_misses", "Walks that started from the root");
+}
+
+size_t PageWalkCache::lookup(PageNumber page) {
+    for (size_t level = levels_ - 1; level > 0; --level) {
+        auto it = entries_.find(make_key(page, level));
+        if (it != entries_.end()) {
+            lru_list_.splice(lru_list_.begin(), lru_list_, it->second);
+            hits_.inc();
+            return level;
+        }
+    }
+    misses_.inc();
+    return 0;
+}
+
+void PageWalkCache::insert(PageNumber page, size_t level) {
+    if (capacity_ == 0 || level == 0 || level >= levels_) {
+        return;
+    }
+
+    uint64_t key = make_key(page, level);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        lru_list_.splice(lru_list_.begin(), lru_list_, it->second);
+        return;
+    }
+
+    if (entries_.size() >= capacity_) {
+        entries_.erase(lru_list_.back());
+        lru_list_.pop_back();
+    }
+    lru_list_.push_front(key);
+    entries_[key] = lru_list_.begin();
+}
+
+void PageWalkCache::clear() {
+    lru_list_.clear();
+    entries_.clear();
+}
+
+uint64_t PageWalkCache::make_key(PageNumber page, size_t level) const {
+    return ((page >> (bits_per_level_ * (levels_ - level))) << 4) | level;
+}
+
+NestedMmu::NestedMmu(const NestedPagingConfig& config, std::shared_ptr<MetricsRegistry> metrics)
+    : config_(config),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()),
+      guest_levels_(config.guest.page_table_levels - (config.guest_huge_pages ? 1 : 0)),
+      host_levels_(config.host.page_table_levels - (config.host_huge_pages ? 1 : 0)),
+      next_guest_frame_(0),
+      next_host_frame_(0),
+      max_walk_refs_(0) {
+
+    if (config.guest.page_size != config.host.page_size) {
+        throw std::invalid_argument("Guest and host must share a base page size");
+    }
+    if (guest_levels_ == 0 || host_levels_ == 0) {
+        throw std::invalid_argument("Huge pages need at least two page table levels");
+    }
+
+    guest_shift_ = config.guest.offset_bits + (config.guest_huge_pages ? config.guest.bits_per_level : 0);
+    host_shift_ = config.host.offset_bits + (config.host_huge_pages ? config.host.bits_per_level : 0);
+    combined_shift_ = std::min(guest_shift_, host_shift_);
+
+    Config guest_tables = config.guest;
+    guest_tables.page_table_levels = guest_levels_;
+    Config host_tables = config.host;
+    host_tables.page_table_levels = host_levels_;
+    guest_pt_ = std::make_unique<PageTable>(guest_tables);
+    host_pt_ = std::make_unique<PageTable>(host_tables);
+
+    tlb_ = std::make_unique<TLB>(config.tlb_size, metrics_, "nested_combined_tlb");
+    if (config.nested_tlb_size > 0) {
+        nested_tlb_ = std::make_unique<TLB>(config.nested_tlb_size, metrics_, "nested_gpa_tlb");
+    }
+    if (config.guest_pwc_size > 0) {
+        guest_pwc_ = std::make_unique<PageWalkCache>(guest_levels_, config.guest.bits_per_level,
+                                                     config.guest_pwc_size, metrics_,
+                                                     "nested_guest_pwc");
+    }
+    if (config.host_pwc_size > 0) {
+        host_pwc_ = std::make_unique<PageWalkCache>(host_levels_, config.host.bits_per_level,
+                                                    config.host_pwc_size, metrics_,
+                                                    "nested_host_pwc");
+    }
+
+    translations_ = metrics_->counter("nested_translations", "Guest virtual address translations");
+    walks_ = metrics_->counter("nested_walks", "Two-dimensional page walks");
+    walk_refs_ = metrics_->counter("nested_walk_memory_refs", "Memory references made by 2D walks");
+    guest_faults_ = metrics_->counter("nested_guest_faults", "Guest page faults");
+    host_faults_ = metrics_->counter("nested_host_faults", "Host faults on guest physical memory");
+    out_of_memory_ = metrics_->counter("nested_out_of_memory",
+                                       "Faults that found guest or host memory exhausted");
+    modelled_cycles_ = metrics_->counter("nested_modelled_cycles", "Modelled nested translation cost");
+    refs_per_walk_ = metrics_->histogram("nested_walk_refs", "Memory references per 2D walk");
+}
+
+std::optional<PhysicalAddress> NestedMmu::translate(VirtualAddress gva) {
+    translations_.inc();
+
+    PageNumber key = gva >> combined_shift_;
+    VirtualAddress combined_mask = (1ULL << combined_shift_) - 1;
+
+    auto cached = tlb_->lookup(key);
+    if (cached.has_value()) {
+        modelled_cycles_.inc(config_.host.tlb_hit_cycles);
+        return (cached.value() << combined_shift_) | (gva & combined_mask);
+    }
+
+    walks_.inc();
+    size_t refs = 0;
+
+    PageNumber gpn = gva >> guest_shift_;
+    PageTableEntry* entry = guest_pt_->get_entry(gpn);
+    if (!entry || !entry->valid) {
+        if (!guest_fault(gpn)) {
+            return std::nullopt;
+        }
+        entry = guest_pt_->get_entry(gpn);
+    }
+    entry->referenced = true;
+
+    size_t start = guest_pwc_ ? guest_pwc_->lookup(gpn) : 0;
+    for (size_t level = start; level < guest_levels_; ++level) {
+        auto node = guest_node_frame(gpn, level);
+        if (!node.has_value() ||
+            !host_translate(node.value() << config_.guest.offset_bits, refs).has_value()) {
+            return std::nullopt;
+        }
+        refs++;
+        if (guest_pwc_ && level > 0) {
+            guest_pwc_->insert(gpn, level);
+        }
+    }
+
+    VirtualAddress guest_mask = (1ULL << guest_shift_) - 1;
+    PhysicalAddress gpa = (entry->frame_number << config_.guest.offset_bits) + (gva & guest_mask);
+    auto hpa = host_translate(gpa, refs);
+    if (!hpa.has_value()) {
+        return std::nullopt;
+    }
+
+    walk_refs_.inc(refs);
+    refs_per_walk_.record(refs);
+    max_walk_refs_ = std::max(max_walk_refs_, refs);
+    modelled_cycles_.inc(config_.host.tlb_hit_cycles + refs * config_.host.page_walk_cycles_per_level);
+
+    tlb_->insert(key, hpa.value() >> combined_shift_);
+    return hpa;
+}
+
+void NestedMmu::flush_tlbs() {
+    tlb_->clear();
+    if (nested_tlb_) {
+        nested_tlb_->clear();
+    }
+    if (guest_pwc_) {
+        guest_pwc_->clear();
+    }
+    if (host_pwc_) {
+        host_pwc_->clear();
+    }
+}
+
+std::optional<FrameNumber> NestedMmu::allocate_frames(FrameNumber& next, size_t limit, size_t shift) {
+    size_t span = 1ULL << (shift - config_.guest.offset_bits);
+    FrameNumber base = (next + span - 1) / span * span;
+    if (base + span > limit) {
+        out_of_memory_.inc();
+        return std::nullopt;
+    }
+    next = base + span;
+    return base;
+}
+
+std::optional<FrameNumber> NestedMmu::guest_node_frame(PageNumber gpn, size_t level) {
+    PageNumber prefix = gpn >> (config_.guest.bits_per_level * (guest_levels_ - level));
+    uint64_t key = (prefix << 4) | level;
+
+    auto it = guest_nodes_.find(key);
+    if (it != guest_nodes_.end()) {
+        return it->second;
+    }
+
+    auto frame = allocate_frames(next_guest_frame_, config_.guest.num_frames, config_.guest.offset_bits);
+    if (frame.has_value()) {
+        guest_nodes_[key] = frame.value();
+    }
+    return frame;
+}
+
+bool NestedMmu::guest_fault(PageNumber gpn) {
+    for (size_t level = 0; level < guest_levels_; ++level) {
+        if (!guest_node_frame(gpn, level).has_value()) {
+            return false;
+        }
+    }
+
+    auto frame = allocate_frames(next_guest_frame_, config_.guest.num_frames, guest_shift_);
+    if (!frame.has_value()) {
+        return false;
+    }
+
+    guest_pt_->insert(gpn, frame.value());
+    guest_faults_.inc();
+    modelled_cycles_.inc(config_.guest.page_fault_cycles);
+    return true;
+}
+
+std::optional<PhysicalAddress> NestedMmu::host_translate(PhysicalAddress gpa, size_t& refs) {
+    PageNumber hpn = gpa >> host_shift_;
+    PhysicalAddress host_mask = (1ULL << host_shift_) - 1;
+
+    if (nested_tlb_) {
+        auto cached = nested_tlb_->lookup(hpn);
+        if (cached.has_value()) {
+            return (cached.value() << config_.host.offset_bits) + (gpa & host_mask);
+        }
+    }
+
+    PageTableEntry* entry = host_pt_->get_entry(hpn);
+    if (!entry || !entry->valid) {
+        auto frame = allocate_frames(next_host_frame_, config_.host.num_frames, host_shift_);
+        if (!frame.has_value()) {
+            return std::nullopt;
+        }
+        host_pt_->insert(hpn, frame.value());
+        host_faults_.inc();
+        modelled_cycles_.inc(config_.host.page_fault_cycles);
+        entry = host_pt_->get_entry(hpn);
+    }
+    entry->referenced = true;
+
+    size_t start = host_pwc_ ? host_pwc_->lookup(hpn) : 0;
+    refs += host_levels_ - start;
+    if (host_pwc_) {
+        for (size_t level = std::max<size_t>(start, 1); level < host_levels_; ++level) {
+            host_pwc_->insert(hpn, level);
+        }
+    }
+
+    if (nested_tlb_) {
+        nested_tlb_->insert(hpn, entry->frame_number);
+    }
+    return (entry->frame_number << config_.host.offset_bits) + (gpa & host_mask);
+}
+
+} // namespace vm
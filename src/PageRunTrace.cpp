@@ -0,0 +1,684 @@
+#include "PageRunTrace.h"
+#include "VirtualMemoryManager.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+namespace vm {
+
+namespace {
+
+constexpr char kHeaderMagic[4] = {'V', 'M', 'P', 'R'};
+constexpr char kIndexMagic[4] = {'V', 'M', 'P', 'I'};
+constexpr uint16_t kFormatVersion = 2;
+constexpr size_t kHeaderSize = 8;
+constexpr size_t kIndexEntrySize = 32;
+constexpr size_t kTrailerSize = 20;
+constexpr size_t kRawBufferSize = 1 << 20;
+
+void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void put_le(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+uint64_t get_le(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+class VarintCursor {
+public:
+    VarintCursor(const uint8_t* data, size_t size) : pos_(data), end_(data + size) {}
+
+    uint64_t next() {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (pos_ == end_) {
+                throw std::runtime_error("Truncated varint in page-run chunk");
+            }
+            uint8_t byte = *pos_++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Overlong varint in page-run chunk");
+    }
+
+    const uint8_t* position() const { return pos_; }
+
+private:
+    const uint8_t* pos_;
+    const uint8_t* end_;
+};
+
+} // namespace
+
+RawTraceReader::RawTraceReader(std::istream& in)
+    : in_(in),
+      buffer_(kRawBufferSize),
+      begin_(0),
+      end_(0),
+      eof_(false),
+      lines_(0),
+      skipped_(0) {}
+
+size_t RawTraceReader::read(MemoryAccess* out, size_t count) {
+    size_t produced = 0;
+    const char* line;
+    size_t length;
+    while (produced < count && next_line(line, length)) {
+        lines_++;
+        if (parse_line(line, length, out[produced])) {
+            produced++;
+        } else {
+            skipped_++;
+        }
+    }
+    return produced;
+}
+
+bool RawTraceReader::next_line(const char*& line, size_t& length) {
+    while (true) {
+        const char* start = buffer_.data() + begin_;
+        const char* newline = static_cast<const char*>(std::memchr(start, '\n', end_ - begin_));
+        if (newline) {
+            line = start;
+            length = static_cast<size_t>(newline - start);
+            begin_ += length + 1;
+            return true;
+        }
+
+        if (eof_) {
+            if (begin_ == end_) {
+                return false;
+            }
+            line = start;
+            length = end_ - begin_;
+            begin_ = end_;
+            return true;
+        }
+
+        size_t remaining = end_ - begin_;
+        if (remaining == buffer_.size()) {
+            buffer_.resize(buffer_.size() * 2);
+        }
+        std::memmove(buffer_.data(), buffer_.data() + begin_, remaining);
+        begin_ = 0;
+        end_ = remaining;
+
+        in_.read(buffer_.data() + end_, static_cast<std::streamsize>(buffer_.size() - end_));
+        end_ += static_cast<size_t>(in_.gcount());
+        if (!in_) {
+            eof_ = true;
+        }
+    }
+}
+
+bool RawTraceReader::parse_line(const char* line, size_t length, MemoryAccess& access) {
+    size_t i = 0;
+    while (i < length && (line[i] == ' ' || line[i] == '\t')) {
+        i++;
+    }
+    if (i == length) {
+        return false;
+    }
+
+    switch (line[i]) {
+    case 'R':
+    case 'L':
+    case 'I':
+        access.write = false;
+        break;
+    case 'W':
+    case 'S':
+    case 'M':
+        access.write = true;
+        break;
+    default:
+        return false;
+    }
+    i++;
+
+    while (i < length && (line[i] == ' ' || line[i] == '\t')) {
+        i++;
+    }
+    if (i + 1 < length && line[i] == '0' && (line[i + 1] == 'x' || line[i + 1] == 'X')) {
+        i += 2;
+    }
+
+    VirtualAddress address = 0;
+    size_t digits = 0;
+    for (; i < length && digits < 16; ++i, ++digits) {
+        char c = line[i];
+        unsigned value;
+        if (c >= '0' && c <= '9') {
+            value = static_cast<unsigned>(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value = static_cast<unsigned>(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            value = static_cast<unsigned>(c - 'A' + 10);
+        } else {
+            break;
+        }
+        address = (address << 4) | value;
+    }
+    if (digits == 0) {
+        return false;
+    }
+
+    access.address = address;
+    return true;
+}
+
+PageRunWriter::PageRunWriter(const std::string& path, size_t page_shift, size_t runs_per_chunk)
+    : out_(path, std::ios::binary | std::ios::trunc),
+      page_shift_(page_shift),
+      runs_per_chunk_(std::max<size_t>(runs_per_chunk, 1)),
+      closed_(false),
+      current_write_(false),
+      current_segment_(0),
+      accesses_(0),
+      runs_(0),
+      bytes_written_(0) {
+
+    if (!out_) {
+        throw std::runtime_error("Cannot open page-run trace for writing: " + path);
+    }
+
+    uint8_t header[kHeaderSize];
+    std::memcpy(header, kHeaderMagic, sizeof(kHeaderMagic));
+    put_le(header + 4, kFormatVersion, 2);
+    put_le(header + 6, page_shift, 2);
+    write_bytes(header, sizeof(header));
+    pending_.reserve(runs_per_chunk_);
+}
+
+PageRunWriter::~PageRunWriter() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void PageRunWriter::add(VirtualAddress vaddr, bool write) {
+    PageNumber vpn = vaddr >> page_shift_;
+    accesses_++;
+
+    if (current_.length > 0 && current_.vpn == vpn &&
+        current_.length < std::numeric_limits<uint32_t>::max()) {
+        current_.length++;
+        current_.writes += write ? 1 : 0;
+        if (write == current_write_) {
+            current_segment_++;
+        } else {
+            pending_segments_.push_back(current_segment_);
+            current_.num_toggles++;
+            current_write_ = write;
+            current_segment_ = 1;
+        }
+        return;
+    }
+
+    end_run();
+    current_.vpn = vpn;
+    current_.length = 1;
+    current_.writes = write ? 1 : 0;
+    current_.first_write = write;
+    current_.num_toggles = 0;
+    current_.toggle_offset = static_cast<uint32_t>(pending_segments_.size());
+    current_write_ = write;
+    current_segment_ = 1;
+}
+
+void PageRunWriter::add(const MemoryAccess* accesses, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        add(accesses[i].address, accesses[i].write);
+    }
+}
+
+void PageRunWriter::close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+
+    end_run();
+    flush_chunk();
+
+    uint64_t index_offset = bytes_written_;
+    uint8_t entry[kIndexEntrySize];
+    for (const auto& info : index_) {
+        put_le(entry, info.offset, 8);
+        put_le(entry + 8, info.bytes, 4);
+        put_le(entry + 12, info.runs, 4);
+        put_le(entry + 16, info.accesses, 8);
+        put_le(entry + 24, info.first_vpn, 8);
+        write_bytes(entry, sizeof(entry));
+    }
+
+    uint8_t trailer[kTrailerSize];
+    put_le(trailer, index_offset, 8);
+    put_le(trailer + 8, index_.size(), 8);
+    std::memcpy(trailer + 16, kIndexMagic, sizeof(kIndexMagic));
+    write_bytes(trailer, sizeof(trailer));
+
+    out_.close();
+    if (!out_) {
+        throw std::runtime_error("Failed to finish page-run trace");
+    }
+}
+
+void PageRunWriter::end_run() {
+    if (current_.length == 0) {
+        return;
+    }
+    pending_.push_back(current_);
+    runs_++;
+    current_.length = 0;
+    if (pending_.size() >= runs_per_chunk_) {
+        flush_chunk();
+    }
+}
+
+void PageRunWriter::flush_chunk() {
+    if (pending_.empty()) {
+        return;
+    }
+
+    std::vector<uint8_t> vpns;
+    std::vector<uint8_t> lengths;
+    std::vector<uint8_t> masks;
+    PageRunChunkInfo info;
+    info.offset = bytes_written_;
+    info.runs = static_cast<uint32_t>(pending_.size());
+    info.accesses = 0;
+    info.first_vpn = pending_.front().vpn;
+
+    // The mask column holds (toggles << 1 | first_write) per run, followed by
+    // the length of every segment but the last, so pure-read and pure-write
+    // runs cost one byte.
+    PageNumber previous = 0;
+    for (const auto& run : pending_) {
+        put_varint(vpns, zigzag_encode(static_cast<int64_t>(run.vpn - previous)));
+        put_varint(lengths, run.length);
+        put_varint(masks, (static_cast<uint64_t>(run.num_toggles) << 1) | (run.first_write ? 1 : 0));
+        for (uint32_t i = 0; i < run.num_toggles; ++i) {
+            put_varint(masks, pending_segments_[run.toggle_offset + i]);
+        }
+        previous = run.vpn;
+        info.accesses += run.length;
+    }
+
+    scratch_.clear();
+    put_varint(scratch_, vpns.size());
+    put_varint(scratch_, lengths.size());
+    put_varint(scratch_, masks.size());
+    scratch_.insert(scratch_.end(), vpns.begin(), vpns.end());
+    scratch_.insert(scratch_.end(), lengths.begin(), lengths.end());
+    scratch_.insert(scratch_.end(), masks.begin(), masks.end());
+
+    info.bytes = static_cast<uint32_t>(scratch_.size());
+    write_bytes(scratch_.data(), scratch_.size());
+    index_.push_back(info);
+    pending_.clear();
+    pending_segments_.clear();
+}
+
+void PageRunWriter::write_bytes(const uint8_t* data, size_t size) {
+    out_.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    if (!out_) {
+        throw std::runtime_error("Failed to write page-run trace");
+    }
+    bytes_written_ += size;
+}
+
+PageRunReader::PageRunReader(const std::string& path)
+    : in_(path, std::ios::binary | std::ios::ate),
+      page_shift_(0) {
+
+    if (!in_) {
+        throw std::runtime_error("Cannot open page-run trace: " + path);
+    }
+
+    uint64_t file_size = static_cast<uint64_t>(in_.tellg());
+    if (file_size < kHeaderSize + kTrailerSize) {
+        throw std::runtime_error("Page-run trace is too small: " + path);
+    }
+
+    uint8_t header[kHeaderSize];
+    in_.seekg(0);
+    in_.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in_ || std::memcmp(header, kHeaderMagic, sizeof(kHeaderMagic)) != 0 ||
+        get_le(header + 4, 2) != kFormatVersion) {
+        throw std::runtime_error("Not a page-run trace: " + path);
+    }
+    page_shift_ = static_cast<size_t>(get_le(header + 6, 2));
+
+    uint8_t trailer[kTrailerSize];
+    in_.seekg(static_cast<std::streamoff>(file_size - kTrailerSize));
+    in_.read(reinterpret_cast<char*>(trailer), sizeof(trailer));
+    uint64_t index_offset = get_le(trailer, 8);
+    uint64_t num_chunks = get_le(trailer + 8, 8);
+    if (!in_ || std::memcmp(trailer + 16, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+        index_offset < kHeaderSize ||
+        index_offset + num_chunks * kIndexEntrySize + kTrailerSize != file_size) {
+        throw std::runtime_error("Corrupt page-run trace index: " + path);
+    }
+
+    std::vector<uint8_t> raw_index(num_chunks * kIndexEntrySize);
+    in_.seekg(static_cast<std::streamoff>(index_offset));
+    in_.read(reinterpret_cast<char*>(raw_index.data()), static_cast<std::streamsize>(raw_index.size()));
+    if (!in_) {
+        throw std::runtime_error("Failed to read page-run trace index: " + path);
+    }
+
+    index_.resize(num_chunks);
+    for (size_t i = 0; i < num_chunks; ++i) {
+        const uint8_t* entry = raw_index.data() + i * kIndexEntrySize;
+        PageRunChunkInfo& info = index_[i];
+        info.offset = get_le(entry, 8);
+        info.bytes = static_cast<uint32_t>(get_le(entry + 8, 4));
+        info.runs = static_cast<uint32_t>(get_le(entry + 12, 4));
+        info.accesses = get_le(entry + 16, 8);
+        info.first_vpn = get_le(entry + 24, 8);
+        if (info.offset + info.bytes > index_offset) {
+            throw std::runtime_error("Page-run chunk lies outside the data section: " + path);
+        }
+    }
+}
+
+uint64_t PageRunReader::get_total_accesses() const {
+    uint64_t total = 0;
+    for (const auto& info : index_) {
+        total += info.accesses;
+    }
+    return total;
+}
+
+uint64_t PageRunReader::get_total_runs() const {
+    uint64_t total = 0;
+    for (const auto& info : index_) {
+        total += info.runs;
+    }
+    return total;
+}
+
+void PageRunReader::read_chunk(size_t chunk, PageRunChunk& out) {
+    std::vector<uint8_t> bytes;
+    read_chunk_bytes(chunk, bytes);
+    decode_chunk(bytes.data(), bytes.size(), index_[chunk].runs, out);
+}
+
+void PageRunReader::decode_chunk(const uint8_t* data, size_t size, size_t expected_runs,
+                                 PageRunChunk& out) {
+    VarintCursor header(data, size);
+    uint64_t vpn_bytes = header.next();
+    uint64_t length_bytes = header.next();
+    uint64_t mask_bytes = header.next();
+
+    const uint8_t* columns = header.position();
+    size_t available = size - static_cast<size_t>(columns - data);
+    if (vpn_bytes > available || length_bytes > available - vpn_bytes ||
+        mask_bytes > available - vpn_bytes - length_bytes) {
+        throw std::runtime_error("Page-run chunk columns overrun the chunk");
+    }
+
+    VarintCursor vpns(columns, vpn_bytes);
+    VarintCursor lengths(columns + vpn_bytes, length_bytes);
+    VarintCursor masks(columns + vpn_bytes + length_bytes, mask_bytes);
+
+    out.runs.resize(expected_runs);
+    out.segments.clear();
+    PageNumber vpn = 0;
+    for (auto& run : out.runs) {
+        vpn += static_cast<PageNumber>(zigzag_decode(vpns.next()));
+        uint64_t mask = masks.next();
+        run.vpn = vpn;
+        run.length = static_cast<uint32_t>(lengths.next());
+        run.first_write = (mask & 1) != 0;
+        run.num_toggles = static_cast<uint32_t>(mask >> 1);
+        run.toggle_offset = static_cast<uint32_t>(out.segments.size());
+        if (run.num_toggles >= run.length) {
+            throw std::runtime_error("Page-run chunk has more R/W toggles than accesses");
+        }
+
+        uint64_t in_toggles = 0;
+        uint32_t writes = 0;
+        bool write = run.first_write;
+        for (uint32_t i = 0; i < run.num_toggles; ++i) {
+            uint64_t segment = masks.next();
+            in_toggles += segment;
+            if (segment == 0 || in_toggles >= run.length) {
+                throw std::runtime_error("Page-run chunk has an invalid R/W segment");
+            }
+            out.segments.push_back(static_cast<uint32_t>(segment));
+            writes += write ? static_cast<uint32_t>(segment) : 0;
+            write = !write;
+        }
+        run.writes = writes + (write ? run.length - static_cast<uint32_t>(in_toggles) : 0);
+    }
+}
+
+void PageRunReader::read_chunk_bytes(size_t chunk, std::vector<uint8_t>& bytes) {
+    const PageRunChunkInfo& info = index_.at(chunk);
+    bytes.resize(info.bytes);
+
+    std::lock_guard<std::mutex> lock(in_mutex_);
+    in_.clear();
+    in_.seekg(static_cast<std::streamoff>(info.offset));
+    in_.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!in_) {
+        throw std::runtime_error("Failed to read page-run chunk");
+    }
+}
+
+PageRunPrefetcher::PageRunPrefetcher(PageRunReader& reader, size_t num_threads, size_t depth)
+    : reader_(reader),
+      num_chunks_(reader.get_num_chunks()),
+      next_claim_(0),
+      next_consume_(0),
+      stop_requested_(false) {
+
+    if (num_threads == 0) {
+        num_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    num_threads = std::min(num_threads, std::max<size_t>(num_chunks_, 1));
+    slots_.resize(depth > 0 ? depth : 2 * num_threads);
+
+    for (size_t t = 0; t < num_threads; ++t) {
+        threads_.emplace_back(&PageRunPrefetcher::run, this);
+    }
+}
+
+PageRunPrefetcher::~PageRunPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_requested_ = true;
+    }
+    space_cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool PageRunPrefetcher::next(PageRunChunk& out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (next_consume_ == num_chunks_) {
+        return false;
+    }
+
+    Slot& slot = slots_[next_consume_ % slots_.size()];
+    ready_cv_.wait(lock, [&] { return slot.ready; });
+    slot.ready = false;
+    next_consume_++;
+    if (slot.error) {
+        std::exception_ptr error = slot.error;
+        slot.error = nullptr;
+        lock.unlock();
+        space_cv_.notify_all();
+        std::rethrow_exception(error);
+    }
+
+    std::swap(out.runs, slot.chunk.runs);
+    std::swap(out.segments, slot.chunk.segments);
+    lock.unlock();
+    space_cv_.notify_all();
+    return true;
+}
+
+void PageRunPrefetcher::run() {
+    PageRunChunk decoded;
+    std::vector<uint8_t> bytes;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        space_cv_.wait(lock, [this] {
+            return stop_requested_ || next_claim_ == num_chunks_ ||
+                   next_claim_ < next_consume_ + slots_.size();
+        });
+        if (stop_requested_ || next_claim_ == num_chunks_) {
+            return;
+        }
+        size_t chunk = next_claim_++;
+        lock.unlock();
+
+        std::exception_ptr error;
+        try {
+            reader_.read_chunk_bytes(chunk, bytes);
+            PageRunReader::decode_chunk(bytes.data(), bytes.size(),
+                                        reader_.get_chunk_info(chunk).runs, decoded);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        // A chunk is claimed only once its slot's previous chunk has been
+        // consumed, so the slot is free to fill.
+        Slot& slot = slots_[chunk % slots_.size()];
+        std::swap(slot.chunk.runs, decoded.runs);
+        std::swap(slot.chunk.segments, decoded.segments);
+        slot.error = error;
+        slot.ready = true;
+        ready_cv_.notify_all();
+    }
+}
+
+TraceConversionStats convert_raw_trace(std::istream& raw, const std::string& output_path,
+                                       size_t page_shift, size_t runs_per_chunk) {
+    RawTraceReader reader(raw);
+    PageRunWriter writer(output_path, page_shift, runs_per_chunk);
+
+    std::vector<MemoryAccess> batch(65536);
+    while (size_t n = reader.read(batch.data(), batch.size())) {
+        writer.add(batch.data(), n);
+    }
+    writer.close();
+
+    TraceConversionStats stats;
+    stats.accesses = writer.get_accesses();
+    stats.runs = writer.get_runs();
+    stats.chunks = writer.get_chunks();
+    stats.output_bytes = writer.get_bytes_written();
+    stats.skipped_lines = reader.get_skipped_lines();
+    return stats;
+}
+
+// Re-reads a raw trace and checks that expanding the page runs of its
+// converted form, chunk by chunk, reproduces every access in order.
+TraceVerificationStats verify_page_run_trace(std::istream& raw, PageRunReader& reader) {
+    RawTraceReader raw_reader(raw);
+    std::vector<MemoryAccess> batch(65536);
+    size_t batch_size = 0;
+    size_t batch_pos = 0;
+    bool raw_done = false;
+
+    TraceVerificationStats stats;
+    auto check = [&](PageNumber vpn, bool write) {
+        if (batch_pos == batch_size && !raw_done) {
+            batch_size = raw_reader.read(batch.data(), batch.size());
+            batch_pos = 0;
+            raw_done = batch_size == 0;
+        }
+        bool match = batch_pos < batch_size &&
+                     (batch[batch_pos].address >> reader.get_page_shift()) == vpn &&
+                     batch[batch_pos].write == write;
+        if (!match && stats.mismatches++ == 0) {
+            stats.first_mismatch = stats.accesses;
+        }
+        batch_pos += batch_pos < batch_size ? 1 : 0;
+        stats.accesses++;
+    };
+
+    PageRunChunk chunk;
+    for (size_t i = 0; i < reader.get_num_chunks(); ++i) {
+        reader.read_chunk(i, chunk);
+        for (const auto& run : chunk.runs) {
+            for_each_run_segment(run, chunk.segments_of(run), [&](bool write, uint32_t count) {
+                for (uint32_t j = 0; j < count; ++j) {
+                    check(run.vpn, write);
+                }
+            });
+        }
+        stats.chunks++;
+    }
+
+    // Raw accesses left over after the last run are missing from the trace.
+    while (true) {
+        if (batch_pos == batch_size) {
+            batch_size = raw_done ? 0 : raw_reader.read(batch.data(), batch.size());
+            batch_pos = 0;
+            if (batch_size == 0) {
+                break;
+            }
+        }
+        if (stats.mismatches++ == 0) {
+            stats.first_mismatch = stats.accesses;
+        }
+        batch_pos++;
+        stats.accesses++;
+    }
+    return stats;
+}
+
+WorkloadRunStats replay_page_runs(VirtualMemoryManager& vmm, PageRunReader& reader) {
+    if (reader.get_page_shift() != vmm.get_config().offset_bits) {
+        throw std::invalid_argument("Trace page size does not match the simulator");
+    }
+
+    WorkloadRunStats stats;
+    PageRunPrefetcher prefetcher(reader);
+    PageRunChunk chunk;
+    while (prefetcher.next(chunk)) {
+        for (const auto& run : chunk.runs) {
+            stats.accesses += run.length;
+            stats.writes += run.writes;
+        }
+        stats.failed += vmm.access_runs(chunk);
+    }
+    stats.reads = stats.accesses - stats.writes;
+    return stats;
+}
+
+} // namespace vm
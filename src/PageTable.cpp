@@ -1,4 +1,5 @@
 #include "PageTable.h"
+#include <algorithm>
 #include <cmath>
 
 namespace vm {
@@ -8,7 +9,9 @@ PageTable::PageTable(const Config& config)
       num_levels_(config.page_table_levels),
       bits_per_level_(config.bits_per_level),
       entries_per_level_(1ULL << config.bits_per_level),
-      num_entries_(0) {
+      num_entries_(0),
+      num_huge_entries_(0),
+      num_nodes_(1) {
 
     root_ = std::make_unique<PageTableNode>(entries_per_level_, num_levels_ == 1);
 }
@@ -17,13 +20,17 @@ std::optional<FrameNumber> PageTable::translate(PageNumber vpn) {
     PageTableEntry* entry = walk_page_table(vpn, false);
     if (entry && entry->valid) {
         entry->referenced = true;
-        return entry->frame_number;
+        return frame_for(*entry, vpn);
     }
     return std::nullopt;
 }
 
-void PageTable::insert(PageNumber vpn, FrameNumber pfn) {
+void PageTable::insert(PageNumber vpn, FrameNumber pfn, uint8_t protection) {
     PageTableEntry* entry = walk_page_table(vpn, true);
+    if (entry && entry->huge) {
+        split_range(vpn, vpn + 1);
+        entry = walk_page_table(vpn, true);
+    }
     if (entry) {
         if (!entry->valid) {
             num_entries_++;
@@ -31,6 +38,7 @@ void PageTable::insert(PageNumber vpn, FrameNumber pfn) {
         entry->frame_number = pfn;
         entry->valid = true;
         entry->referenced = true;
+        entry->protection = protection;
     }
 }
 
@@ -61,13 +69,98 @@ void PageTable::invalidate(PageNumber vpn) {
     PageTableEntry* entry = walk_page_table(vpn, false);
     if (entry && entry->valid) {
         entry->valid = false;
-        num_entries_--;
+        if (entry->huge) {
+            entry->huge = false;
+            num_huge_entries_--;
+        } else {
+            num_entries_--;
+        }
+    }
+}
+
+size_t PageTable::unmap_range(PageNumber start, PageNumber end,
+                              std::vector<std::pair<PageNumber, FrameNumber>>& unmapped) {
+    size_t before = unmapped.size();
+    if (start < end) {
+        split_range(start, end);
+        unmap_node(root_.get(), 0, 0, start, end, unmapped);
     }
+    return unmapped.size() - before;
+}
+
+size_t PageTable::protect_range(PageNumber start, PageNumber end, uint8_t protection) {
+    size_t updated = 0;
+    if (start < end) {
+        split_range(start, end);
+        for_each_leaf(root_.get(), 0, 0, start, end,
+                      [&](PageNumber, PageTableEntry& entry) {
+                          if (entry.valid) {
+                              entry.protection = protection;
+                              updated++;
+                          }
+                      });
+    }
+    return updated;
 }
 
 void PageTable::clear() {
     root_ = std::make_unique<PageTableNode>(entries_per_level_, num_levels_ == 1);
     num_entries_ = 0;
+    num_huge_entries_ = 0;
+    num_nodes_ = 1;
+}
+
+bool PageTable::collapse(PageNumber base, FrameNumber base_pfn, uint8_t protection, bool dirty) {
+    size_t span = get_huge_page_pages();
+    if (span == 0 || base % span != 0 || base_pfn % span != 0) {
+        return false;
+    }
+
+    PageTableNode* parent = walk_to_huge_level(base, true);
+    size_t index = extract_level_index(base, num_levels_ - 2);
+    if (parent->huge.empty()) {
+        parent->huge.resize(entries_per_level_);
+    }
+    if (parent->huge[index].valid) {
+        return false;
+    }
+
+    std::unique_ptr<PageTableNode>& leaf = parent->children[index];
+    if (leaf) {
+        num_entries_ -= std::count_if(leaf->entries.begin(), leaf->entries.end(),
+                                      [](const PageTableEntry& entry) { return entry.valid; });
+        leaf.reset();
+        num_nodes_--;
+    }
+
+    PageTableEntry& entry = parent->huge[index];
+    entry.frame_number = base_pfn;
+    entry.valid = true;
+    entry.dirty = dirty;
+    entry.referenced = true;
+    entry.huge = true;
+    entry.protection = protection;
+    num_huge_entries_++;
+    return true;
+}
+
+size_t PageTable::split_range(PageNumber start, PageNumber end) {
+    if (num_huge_entries_ == 0 || start >= end) {
+        return 0;
+    }
+    return split_node(root_.get(), 0, 0, start, end);
+}
+
+const PageTableEntry* PageTable::get_leaf_entries(PageNumber vpn) {
+    if (num_levels_ < 2) {
+        return nullptr;
+    }
+    PageTableNode* parent = walk_to_huge_level(vpn, false);
+    if (!parent) {
+        return nullptr;
+    }
+    const auto& leaf = parent->children[extract_level_index(vpn, num_levels_ - 2)];
+    return leaf ? leaf->entries.data() : nullptr;
 }
 
 size_t PageTable::extract_level_index(PageNumber vpn, size_t level) const {
@@ -76,6 +169,10 @@ size_t PageTable::extract_level_index(PageNumber vpn, size_t level) const {
     return (vpn >> shift) & mask;
 }
 
+PageNumber PageTable::level_span(size_t level) const {
+    return 1ULL << ((num_levels_ - 1 - level) * bits_per_level_);
+}
+
 PageTableEntry* PageTable::walk_page_table(PageNumber vpn, bool create) {
     PageTableNode* current = root_.get();
 
@@ -85,6 +182,9 @@ PageTableEntry* PageTable::walk_page_table(PageNumber vpn, bool create) {
         if (current->is_leaf) {
             return &current->entries[index];
         }
+        if (!current->huge.empty() && current->huge[index].valid) {
+            return &current->huge[index];
+        }
 
         if (!current->children[index]) {
             if (!create) {
@@ -93,6 +193,7 @@ PageTableEntry* PageTable::walk_page_table(PageNumber vpn, bool create) {
             bool is_last_level = (level == num_levels_ - 2);
             current->children[index] = std::make_unique<PageTableNode>(
                 entries_per_level_, is_last_level);
+            num_nodes_++;
         }
 
         current = current->children[index].get();
@@ -101,4 +202,156 @@ PageTableEntry* PageTable::walk_page_table(PageNumber vpn, bool create) {
     return nullptr;
 }
 
+PageTable::PageTableNode* PageTable::walk_to_huge_level(PageNumber vpn, bool create) {
+    PageTableNode* current = root_.get();
+    for (size_t level = 0; level + 2 < num_levels_; ++level) {
+        std::unique_ptr<PageTableNode>& child = current->children[extract_level_index(vpn, level)];
+        if (!child) {
+            if (!create) {
+                return nullptr;
+            }
+            child = std::make_unique<PageTableNode>(entries_per_level_, false);
+            num_nodes_++;
+        }
+        current = child.get();
+    }
+    return current;
+}
+
+size_t PageTable::split_node(PageTableNode* node, size_t level, PageNumber base,
+                             PageNumber start, PageNumber end) {
+    size_t split = 0;
+    PageNumber span = level_span(level);
+    for (size_t i = 0; i < entries_per_level_; ++i) {
+        PageNumber child_base = base + i * span;
+        if (child_base + span <= start || child_base >= end) {
+            continue;
+        }
+
+        if (level + 2 < num_levels_) {
+            if (node->children[i]) {
+                split += split_node(node->children[i].get(), level + 1, child_base, start, end);
+            }
+            continue;
+        }
+        if (node->huge.empty() || !node->huge[i].valid) {
+            continue;
+        }
+
+        // Re-create the last-level table with one entry per base page of the
+        // huge frame run, inheriting the huge entry's bits.
+        PageTableEntry huge = node->huge[i];
+        node->huge[i] = PageTableEntry();
+        auto leaf = std::make_unique<PageTableNode>(entries_per_level_, true);
+        for (size_t j = 0; j < entries_per_level_; ++j) {
+            leaf->entries[j] = huge;
+            leaf->entries[j].huge = false;
+            leaf->entries[j].frame_number = huge.frame_number + j;
+        }
+        node->children[i] = std::move(leaf);
+        num_nodes_++;
+        num_entries_ += entries_per_level_;
+        num_huge_entries_--;
+        split++;
+    }
+    return split;
+}
+
+bool PageTable::unmap_node(PageTableNode* node, size_t level, PageNumber base,
+                           PageNumber start, PageNumber end,
+                           std::vector<std::pair<PageNumber, FrameNumber>>& unmapped) {
+    bool empty = true;
+
+    if (node->is_leaf) {
+        for (size_t i = 0; i < entries_per_level_; ++i) {
+            PageNumber vpn = base + i;
+            PageTableEntry& entry = node->entries[i];
+            if (entry.valid && vpn >= start && vpn < end) {
+                unmapped.emplace_back(vpn, entry.frame_number);
+                entry = PageTableEntry();
+                num_entries_--;
+            }
+            if (entry.valid) {
+                empty = false;
+            }
+        }
+        return empty;
+    }
+
+    if (std::any_of(node->huge.begin(), node->huge.end(),
+                    [](const PageTableEntry& entry) { return entry.valid; })) {
+        empty = false;
+    }
+
+    PageNumber span = level_span(level);
+    for (size_t i = 0; i < entries_per_level_; ++i) {
+        std::unique_ptr<PageTableNode>& child = node->children[i];
+        if (!child) {
+            continue;
+        }
+
+        PageNumber child_base = base + i * span;
+        PageNumber child_end = child_base + span;
+        if (child_end <= start || child_base >= end) {
+            empty = false;
+            continue;
+        }
+
+        if (start <= child_base && child_end <= end) {
+            release_subtree(child, level + 1, child_base, unmapped);
+        } else if (unmap_node(child.get(), level + 1, child_base, start, end, unmapped)) {
+            child.reset();
+            num_nodes_--;
+        } else {
+            empty = false;
+        }
+    }
+    return empty;
+}
+
+void PageTable::release_subtree(std::unique_ptr<PageTableNode>& node, size_t level, PageNumber base,
+                                std::vector<std::pair<PageNumber, FrameNumber>>& unmapped) {
+    if (node->is_leaf) {
+        for (size_t i = 0; i < entries_per_level_; ++i) {
+            if (node->entries[i].valid) {
+                unmapped.emplace_back(base + i, node->entries[i].frame_number);
+                num_entries_--;
+            }
+        }
+    } else {
+        PageNumber span = level_span(level);
+        for (size_t i = 0; i < entries_per_level_; ++i) {
+            if (node->children[i]) {
+                release_subtree(node->children[i], level + 1, base + i * span, unmapped);
+            }
+        }
+    }
+
+    node.reset();
+    num_nodes_--;
+}
+
+template <typename Fn>
+void PageTable::for_each_leaf(PageTableNode* node, size_t level, PageNumber base,
+                              PageNumber start, PageNumber end, Fn&& fn) {
+    if (node->is_leaf) {
+        size_t first = start > base ? static_cast<size_t>(start - base) : 0;
+        size_t last = static_cast<size_t>(std::min<PageNumber>(end - base, entries_per_level_));
+        for (size_t i = first; i < last; ++i) {
+            fn(base + i, node->entries[i]);
+        }
+        return;
+    }
+
+    PageNumber span = level_span(level);
+    for (size_t i = 0; i < entries_per_level_; ++i) {
+        PageTableNode* child = node->children[i].get();
+        PageNumber child_base = base + i * span;
+        if (!child || child_base + span <= start || child_base >= end) {
+            continue;
+        }
+        for_each_leaf(child, level + 1, child_base, start, end, fn);
+    }
+}
+
 } // namespace vm
@@ -1,40 +1,92 @@
 #include "PhysicalMemory.h"
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 namespace vm {
 
-PhysicalMemory::PhysicalMemory(const Config& config)
+PhysicalMemory::PhysicalMemory(const Config& config, std::shared_ptr<MetricsRegistry> metrics)
     : config_(config),
       num_frames_(config.num_frames),
       allocated_frames_(0),
-      page_faults_(0) {
+      clock_hand_(0),
+      num_free_frames_(0),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()) {
+
+    frame_allocations_ = metrics_->counter("frame_allocations", "Frame allocation requests");
+    allocated_gauge_ = metrics_->gauge("allocated_frames", "Frames currently allocated");
+    free_gauge_ = metrics_->gauge("free_frames", "Frames on the free list");
+    colour_fallbacks_ = metrics_->counter("colour_fallbacks",
+                                          "Coloured allocations served from another colour");
+    contiguous_allocations_ = metrics_->counter("contiguous_allocations",
+                                                "Aligned multi-frame runs allocated");
+    contiguous_failures_ = metrics_->counter("contiguous_allocation_failures",
+                                             "Multi-frame allocations with no free aligned run");
 
     frames_.resize(num_frames_);
     memory_.resize(config.physical_memory_size, 0);
 
+    size_t num_colours = 1;
+    if (config.page_colouring && config.llc_associativity > 0) {
+        num_colours = std::max<size_t>(config.llc_size / (config.llc_associativity * config.page_size), 1);
+    }
+    run_frames_ = config.page_table_levels > 1 ? (1ULL << config.bits_per_level) : 0;
+    if (run_frames_ > 0) {
+        run_free_.assign(num_frames_ / run_frames_, 0);
+    }
+
+    free_lists_.assign(num_colours, FreeList{kNoFrame, kNoFrame, 0});
+    free_next_.assign(num_frames_, kNoFrame);
+    free_prev_.assign(num_frames_, kNoFrame);
     for (size_t i = 0; i < num_frames_; ++i) {
-        free_frames_.push(i);
+        push_free_frame(i);
     }
+    allocated_gauge_.set(0);
+    free_gauge_.set(static_cast<int64_t>(num_frames_));
 }
 
+// Never hands out a mapped frame: when the free lists are empty the caller
+// must reclaim one (VirtualMemoryManager::ensure_free_frame) and retry.
 std::optional<FrameNumber> PhysicalMemory::allocate_frame(PageNumber vpn) {
-    page_faults_++;
+    frame_allocations_.inc();
+    if (num_free_frames_ == 0) {
+        return std::nullopt;
+    }
 
-    if (!free_frames_.empty()) {
-        FrameNumber pfn = free_frames_.front();
-        free_frames_.pop();
+    size_t preferred = vpn % free_lists_.size();
+    size_t colour = preferred;
+    while (free_lists_[colour].size == 0) {
+        colour = (colour + 1) % free_lists_.size();
+    }
+    if (colour != preferred) {
+        colour_fallbacks_.inc();
+    }
 
-        frames_[pfn].allocated = true;
-        frames_[pfn].owner_vpn = vpn;
-        allocated_frames_++;
+    FrameNumber pfn = free_lists_[colour].head;
+    take_frame(pfn, vpn);
+    return pfn;
+}
 
-        return pfn;
+std::optional<FrameNumber> PhysicalMemory::allocate_contiguous(size_t count, PageNumber first_vpn) {
+    if (count != run_frames_ || run_frames_ == 0) {
+        throw std::invalid_argument("Contiguous allocations must span one huge page");
+    }
+    frame_allocations_.inc();
+    if (free_runs_.empty()) {
+        contiguous_failures_.inc();
+        return std::nullopt;
     }
 
-    return find_victim_frame();
+    FrameNumber base = *free_runs_.begin() * run_frames_;
+    for (size_t i = 0; i < count; ++i) {
+        take_frame(base + i, first_vpn + i);
+        frames_[base + i].reclaimed = false;
+    }
+    contiguous_allocations_.inc();
+    return base;
 }
 
-void PhysicalMemory::free_frame(FrameNumber pfn) {
+void PhysicalMemory::free_frame(FrameNumber pfn, bool reclaimed) {
     if (pfn >= num_frames_) {
         throw std::out_of_range("Invalid frame number");
     }
@@ -43,8 +95,11 @@ void PhysicalMemory::free_frame(FrameNumber pfn) {
         frames_[pfn].allocated = false;
         frames_[pfn].owner_vpn = 0;
         frames_[pfn].pinned = false;
+        frames_[pfn].reclaimed = reclaimed;
         allocated_frames_--;
-        free_frames_.push(pfn);
+        push_free_frame(pfn);
+        allocated_gauge_.add(-1);
+        free_gauge_.add(1);
     }
 }
 
@@ -90,14 +145,80 @@ void PhysicalMemory::write_byte(PhysicalAddress addr, uint8_t value) {
     memory_[addr] = value;
 }
 
-std::optional<FrameNumber> PhysicalMemory::find_victim_frame() {
-    for (size_t i = 0; i < num_frames_; ++i) {
-        if (frames_[i].allocated && !frames_[i].pinned) {
-            return i;
+uint8_t* PhysicalMemory::get_frame_data(FrameNumber pfn) {
+    if (pfn >= num_frames_) {
+        throw std::out_of_range("Invalid frame number");
+    }
+    return memory_.data() + pfn * config_.page_size;
+}
+
+void PhysicalMemory::zero_frame(FrameNumber pfn) {
+    std::memset(get_frame_data(pfn), 0, config_.page_size);
+}
+
+std::optional<FrameNumber> PhysicalMemory::next_victim_candidate() {
+    for (size_t scanned = 0; scanned < num_frames_; ++scanned) {
+        FrameNumber pfn = clock_hand_;
+        clock_hand_ = (clock_hand_ + 1) % num_frames_;
+        if (frames_[pfn].allocated && !frames_[pfn].pinned) {
+            return pfn;
         }
     }
 
     return std::nullopt;
 }
 
+void PhysicalMemory::push_free_frame(FrameNumber pfn) {
+    FreeList& list = free_lists_[get_frame_colour(pfn)];
+    free_next_[pfn] = kNoFrame;
+    free_prev_[pfn] = list.tail;
+    if (list.tail != kNoFrame) {
+        free_next_[list.tail] = pfn;
+    } else {
+        list.head = pfn;
+    }
+    list.tail = pfn;
+    list.size++;
+    num_free_frames_++;
+
+    size_t run = run_frames_ > 0 ? pfn / run_frames_ : run_free_.size();
+    if (run < run_free_.size() && ++run_free_[run] == run_frames_) {
+        free_runs_.insert(run);
+    }
+}
+
+void PhysicalMemory::unlink_free_frame(FrameNumber pfn) {
+    FreeList& list = free_lists_[get_frame_colour(pfn)];
+    FrameNumber prev = free_prev_[pfn];
+    FrameNumber next = free_next_[pfn];
+    if (prev != kNoFrame) {
+        free_next_[prev] = next;
+    } else {
+        list.head = next;
+    }
+    if (next != kNoFrame) {
+        free_prev_[next] = prev;
+    } else {
+        list.tail = prev;
+    }
+    free_next_[pfn] = kNoFrame;
+    free_prev_[pfn] = kNoFrame;
+    list.size--;
+    num_free_frames_--;
+
+    size_t run = run_frames_ > 0 ? pfn / run_frames_ : run_free_.size();
+    if (run < run_free_.size() && run_free_[run]-- == run_frames_) {
+        free_runs_.erase(run);
+    }
+}
+
+void PhysicalMemory::take_frame(FrameNumber pfn, PageNumber vpn) {
+    unlink_free_frame(pfn);
+    frames_[pfn].allocated = true;
+    frames_[pfn].owner_vpn = vpn;
+    allocated_frames_++;
+    allocated_gauge_.add(1);
+    free_gauge_.add(-1);
+}
+
 } // namespace vm
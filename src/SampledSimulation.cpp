@@ -0,0 +1,378 @@
+#include "SampledSimulation.h"
+#include "VirtualMemoryManager.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace vm {
+
+namespace {
+
+constexpr double kTwoPi = 6.283185307179586;
+
+struct Clustering {
+    std::vector<uint32_t> assignment;
+    std::vector<double> centroids;
+    std::vector<size_t> sizes;
+    double distortion;
+};
+
+double squared_distance(const float* point, const double* centroid, size_t dims) {
+    double sum = 0.0;
+    for (size_t d = 0; d < dims; ++d) {
+        double diff = point[d] - centroid[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+void copy_point(const float* point, double* centroid, size_t dims) {
+    std::copy(point, point + dims, centroid);
+}
+
+// k-means with k-means++ seeding over row-major signature vectors.
+Clustering kmeans(const std::vector<float>& points, size_t count, size_t dims, size_t k,
+                  size_t iterations, RandomLanes& rng) {
+    Clustering result;
+    result.centroids.assign(k * dims, 0.0);
+    result.assignment.assign(count, 0);
+    result.sizes.assign(k, 0);
+    result.distortion = 0.0;
+
+    std::vector<double> nearest(count, std::numeric_limits<double>::max());
+    copy_point(&points[bounded_random(rng.next(), count) * dims], &result.centroids[0], dims);
+    for (size_t c = 1; c < k; ++c) {
+        double total = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            nearest[i] = std::min(nearest[i], squared_distance(&points[i * dims],
+                                                               &result.centroids[(c - 1) * dims], dims));
+            total += nearest[i];
+        }
+
+        size_t pick = bounded_random(rng.next(), count);
+        if (total > 0.0) {
+            double target = rng.next_double() * total;
+            for (pick = 0; pick + 1 < count && target >= nearest[pick]; ++pick) {
+                target -= nearest[pick];
+            }
+        }
+        copy_point(&points[pick * dims], &result.centroids[c * dims], dims);
+    }
+
+    std::vector<double> sums(k * dims);
+    for (size_t iteration = 0; iteration <= iterations; ++iteration) {
+        bool changed = false;
+        result.distortion = 0.0;
+        std::fill(result.sizes.begin(), result.sizes.end(), 0);
+        std::fill(sums.begin(), sums.end(), 0.0);
+
+        for (size_t i = 0; i < count; ++i) {
+            const float* point = &points[i * dims];
+            uint32_t best = 0;
+            double best_distance = std::numeric_limits<double>::max();
+            for (size_t c = 0; c < k; ++c) {
+                double distance = squared_distance(point, &result.centroids[c * dims], dims);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = static_cast<uint32_t>(c);
+                }
+            }
+            changed = changed || result.assignment[i] != best;
+            result.assignment[i] = best;
+            result.distortion += best_distance;
+            result.sizes[best]++;
+            for (size_t d = 0; d < dims; ++d) {
+                sums[best * dims + d] += point[d];
+            }
+        }
+
+        if (!changed && iteration > 0) {
+            break;
+        }
+        for (size_t c = 0; c < k; ++c) {
+            if (result.sizes[c] == 0) {
+                continue;
+            }
+            for (size_t d = 0; d < dims; ++d) {
+                result.centroids[c * dims + d] = sums[c * dims + d] / result.sizes[c];
+            }
+        }
+    }
+    return result;
+}
+
+// Bayesian information criterion of a clustering under a spherical Gaussian
+// model, as used by SimPoint to pick the number of phases.
+double bic_score(const Clustering& clustering, size_t count, size_t dims, size_t k) {
+    double r = static_cast<double>(count);
+    double m = static_cast<double>(dims);
+    double variance = count > k ? clustering.distortion / (m * (r - k)) : 0.0;
+    variance = std::max(variance, 1e-12);
+
+    double log_likelihood = -r * m / 2.0 * std::log(kTwoPi * variance) - m * (r - k) / 2.0;
+    for (size_t size : clustering.sizes) {
+        if (size > 0) {
+            log_likelihood += size * std::log(size / r);
+        }
+    }
+
+    double parameters = (k - 1) + m * k + 1;
+    return log_likelihood - parameters / 2.0 * std::log(r);
+}
+
+struct MetricSnapshot {
+    uint64_t cycles;
+    uint64_t tlb_misses;
+    uint64_t page_faults;
+    uint64_t fault_cycles;
+};
+
+MetricSnapshot snapshot(VirtualMemoryManager& vmm) {
+    return {vmm.get_modelled_cycles(), vmm.get_tlb_misses(), vmm.get_page_faults(),
+            vmm.get_fault_cycles()};
+}
+
+// Stratified estimate of a run total from per-interval samples, with the
+// finite population correction for each phase. Phases with a single sample
+// borrow the pooled within-phase variance; if no phase has two samples to
+// pool, the interval is reported as unknown.
+SampledEstimate stratified_estimate(const PhaseProfile& profile,
+                                    const std::vector<std::vector<double>>& samples) {
+    double pooled_sum = 0.0;
+    double pooled_dof = 0.0;
+    std::vector<double> means(samples.size(), 0.0);
+    std::vector<double> variances(samples.size(), -1.0);
+
+    for (size_t phase = 0; phase < samples.size(); ++phase) {
+        const auto& values = samples[phase];
+        if (values.empty()) {
+            continue;
+        }
+        double sum = 0.0;
+        for (double value : values) {
+            sum += value;
+        }
+        means[phase] = sum / values.size();
+        if (values.size() > 1) {
+            double squares = 0.0;
+            for (double value : values) {
+                squares += (value - means[phase]) * (value - means[phase]);
+            }
+            variances[phase] = squares / (values.size() - 1);
+            pooled_sum += squares;
+            pooled_dof += values.size() - 1;
+        }
+    }
+    double pooled = pooled_dof > 0.0 ? pooled_sum / pooled_dof : -1.0;
+
+    SampledEstimate estimate;
+    double variance = 0.0;
+    for (size_t phase = 0; phase < samples.size(); ++phase) {
+        double weight = profile.phase_weights[phase];
+        double n = static_cast<double>(samples[phase].size());
+        if (n == 0.0) {
+            continue;
+        }
+        estimate.value += weight * means[phase];
+
+        double s2 = variances[phase] >= 0.0 ? variances[phase] : pooled;
+        double correction = std::max(1.0 - n / weight, 0.0);
+        if (correction == 0.0) {
+            continue;
+        }
+        if (s2 < 0.0) {
+            estimate.interval_known = false;
+            continue;
+        }
+        variance += weight * weight * correction * s2 / n;
+    }
+    estimate.half_width = estimate.interval_known ? profile.config.z_score * std::sqrt(variance)
+                                                  : std::numeric_limits<double>::infinity();
+    return estimate;
+}
+
+} // namespace
+
+size_t PhaseProfile::get_num_samples() const {
+    size_t total = 0;
+    for (const auto& phase : samples) {
+        total += phase.size();
+    }
+    return total;
+}
+
+PhaseProfile profile_phases(WorkloadGenerator& generator, size_t count, size_t page_shift,
+                            const SamplingConfig& config) {
+    if (config.interval_length == 0 || config.signature_dims == 0 || config.max_phases == 0 ||
+        config.samples_per_phase == 0 || config.warmup_length > config.interval_length) {
+        throw std::invalid_argument("Invalid sampling configuration");
+    }
+    if (count == 0) {
+        throw std::invalid_argument("Cannot profile an empty workload");
+    }
+
+    PhaseProfile profile;
+    profile.config = config;
+    profile.num_accesses = count;
+    profile.num_intervals = (count + config.interval_length - 1) / config.interval_length;
+
+    // Each interval's signature is its page-access histogram hashed down to a
+    // few dimensions and normalised, so intervals touching the same pages with
+    // the same intensity land close together.
+    const size_t dims = config.signature_dims;
+    std::vector<float> signatures(profile.num_intervals * dims, 0.0f);
+    std::vector<MemoryAccess> buffer(config.interval_length);
+    generator.reset();
+    for (size_t interval = 0; interval < profile.num_intervals; ++interval) {
+        size_t n = std::min(config.interval_length, count - interval * config.interval_length);
+        generator.generate(buffer.data(), n);
+
+        float* signature = &signatures[interval * dims];
+        for (size_t i = 0; i < n; ++i) {
+            PageNumber vpn = buffer[i].address >> page_shift;
+            signature[bounded_random(vpn * 0x9E3779B97F4A7C15ULL, dims)] += 1.0f;
+        }
+        for (size_t d = 0; d < dims; ++d) {
+            signature[d] /= static_cast<float>(n);
+        }
+    }
+    generator.reset();
+
+    RandomLanes rng(config.seed);
+    size_t max_k = std::min(config.max_phases, profile.num_intervals);
+    std::vector<Clustering> clusterings;
+    std::vector<double> scores;
+    for (size_t k = 1; k <= max_k; ++k) {
+        clusterings.push_back(kmeans(signatures, profile.num_intervals, dims, k,
+                                     config.kmeans_iterations, rng));
+        scores.push_back(bic_score(clusterings.back(), profile.num_intervals, dims, k));
+    }
+
+    double best = *std::max_element(scores.begin(), scores.end());
+    double worst = *std::min_element(scores.begin(), scores.end());
+    size_t chosen = 0;
+    while (scores[chosen] < worst + config.bic_threshold * (best - worst)) {
+        chosen++;
+    }
+    const Clustering& clustering = clusterings[chosen];
+
+    // Drop empty clusters so phases are numbered densely.
+    std::vector<uint32_t> renumber(chosen + 1, 0);
+    for (size_t c = 0; c <= chosen; ++c) {
+        if (clustering.sizes[c] > 0) {
+            renumber[c] = static_cast<uint32_t>(profile.num_phases++);
+        }
+    }
+
+    profile.phase_of.resize(profile.num_intervals);
+    profile.phase_weights.assign(profile.num_phases, 0.0);
+    std::vector<std::vector<size_t>> members(profile.num_phases);
+    std::vector<size_t> representative(profile.num_phases, 0);
+    std::vector<double> representative_distance(profile.num_phases, std::numeric_limits<double>::max());
+
+    for (size_t interval = 0; interval < profile.num_intervals; ++interval) {
+        uint32_t cluster = clustering.assignment[interval];
+        uint32_t phase = renumber[cluster];
+        profile.phase_of[interval] = phase;
+        members[phase].push_back(interval);
+
+        size_t n = std::min(config.interval_length, count - interval * config.interval_length);
+        profile.phase_weights[phase] += static_cast<double>(n) / config.interval_length;
+
+        double distance = squared_distance(&signatures[interval * dims],
+                                           &clustering.centroids[cluster * dims], dims);
+        if (distance < representative_distance[phase]) {
+            representative_distance[phase] = distance;
+            representative[phase] = interval;
+        }
+    }
+
+    profile.samples.resize(profile.num_phases);
+    for (size_t phase = 0; phase < profile.num_phases; ++phase) {
+        auto& pool = members[phase];
+        std::swap(*std::find(pool.begin(), pool.end(), representative[phase]), pool.front());
+
+        size_t wanted = std::min(config.samples_per_phase, pool.size());
+        for (size_t i = 1; i < wanted; ++i) {
+            std::swap(pool[i], pool[i + bounded_random(rng.next(), pool.size() - i)]);
+        }
+        profile.samples[phase].assign(pool.begin(), pool.begin() + wanted);
+    }
+    return profile;
+}
+
+SampledRunStats run_sampled(VirtualMemoryManager& vmm, WorkloadGenerator& generator,
+                            const PhaseProfile& profile, bool map_footprint) {
+    if (map_footprint) {
+        map_workload_footprint(vmm, generator);
+    }
+
+    const size_t length = profile.config.interval_length;
+    std::vector<uint8_t> detailed(profile.num_intervals, 0);
+    for (const auto& phase : profile.samples) {
+        for (size_t interval : phase) {
+            detailed[interval] = 1;
+        }
+    }
+
+    // Page faults depend only on residency, which fast-forwarding keeps
+    // exact, so they are counted over the whole run. Only the translation
+    // cost outside of faults is sampled and extrapolated.
+    SampledRunStats stats;
+    FastForwardResult exact;
+    std::vector<std::vector<double>> cycles(profile.num_phases);
+    std::vector<std::vector<double>> tlb_misses(profile.num_phases);
+    std::vector<MemoryAccess> buffer(length);
+
+    generator.reset();
+    for (size_t interval = 0; interval < profile.num_intervals; ++interval) {
+        size_t n = std::min(length, profile.num_accesses - interval * length);
+        generator.generate(buffer.data(), n);
+        stats.accesses += n;
+
+        bool measured = detailed[interval];
+        bool warm = !measured && interval + 1 < profile.num_intervals && detailed[interval + 1];
+        size_t skipped = measured ? 0 : n - (warm ? std::min(profile.config.warmup_length, n) : 0);
+
+        // Skipped intervals only keep page residency current. The tail before
+        // a detailed interval runs in detail, unmeasured, to warm the TLB.
+        FastForwardResult forwarded = vmm.fast_forward(buffer.data(), skipped);
+        exact.faults += forwarded.faults;
+        exact.fault_cycles += forwarded.fault_cycles;
+        stats.fast_forwarded_accesses += skipped;
+
+        MetricSnapshot before = snapshot(vmm);
+        for (size_t i = skipped; i < n; ++i) {
+            vmm.access(buffer[i].address, buffer[i].write);
+        }
+        MetricSnapshot after = snapshot(vmm);
+
+        uint64_t faults = after.page_faults - before.page_faults;
+        uint64_t fault_cycles = after.fault_cycles - before.fault_cycles;
+        exact.faults += faults;
+        exact.fault_cycles += fault_cycles;
+        if (!measured) {
+            stats.warmup_accesses += n - skipped;
+            continue;
+        }
+
+        // Scale a short trailing interval up to a full one; its phase weight
+        // was scaled down to match.
+        double scale = static_cast<double>(length) / n;
+        uint32_t phase = profile.phase_of[interval];
+        cycles[phase].push_back((after.cycles - before.cycles - fault_cycles) * scale);
+        tlb_misses[phase].push_back((after.tlb_misses - before.tlb_misses - faults) * scale);
+        stats.detailed_accesses += n;
+        stats.detailed_intervals++;
+    }
+
+    stats.modelled_cycles = stratified_estimate(profile, cycles);
+    stats.modelled_cycles.value += exact.fault_cycles;
+    stats.tlb_misses = stratified_estimate(profile, tlb_misses);
+    stats.tlb_misses.value += exact.faults;
+    stats.page_faults.value = exact.faults;
+    return stats;
+}
+
+} // namespace vm
@@ -0,0 +1,185 @@
+#include "SharedAddressSpace.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace vm {
+
+SharedAddressSpace::SharedAddressSpace(const Config& config, std::shared_ptr<MetricsRegistry> metrics)
+    : config_(config),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()),
+      page_table_(config),
+      next_frame_(0),
+      walk_cycles_(config.page_table_levels * config.page_walk_cycles_per_level) {
+
+    total_accesses_ = metrics_->counter("shared_accesses", "Translations in the shared address space");
+    page_faults_ = metrics_->counter("shared_page_faults", "Faults that installed a new frame");
+    fault_races_ = metrics_->counter("shared_fault_races",
+                                     "Faults that found the page installed by another thread");
+    segfaults_ = metrics_->counter("shared_segfaults", "Translations outside every mapped region");
+    protection_faults_ = metrics_->counter("shared_protection_faults",
+                                           "Translations refused by the page's protection bits");
+    out_of_memory_ = metrics_->counter("shared_out_of_memory", "Faults that found no free frame");
+    modelled_cycles_ = metrics_->counter("shared_modelled_cycles", "Modelled translation and fault cost");
+}
+
+bool SharedAddressSpace::mmap(VirtualAddress addr, size_t length, uint8_t protection) {
+    VirtualAddress end = addr + ((length + config_.page_size - 1) & ~(config_.page_size - 1));
+    if (length == 0 || addr % config_.page_size != 0 || vmas_.overlaps(addr, end)) {
+        return false;
+    }
+    vmas_.insert(VirtualMemoryArea(addr, end, protection, VmaBacking::Anonymous));
+    return true;
+}
+
+// Each replay thread's TLB gets its own counters, so per-thread hit rates stay
+// visible; re-creating the TLB for the same thread index reuses them.
+std::unique_ptr<TLB> SharedAddressSpace::create_tlb(size_t thread) const {
+    return std::make_unique<TLB>(config_.tlb_size, metrics_, "shared_tlb_thread" + std::to_string(thread));
+}
+
+// Protection lives in the atomic PTE word and is checked on every path, as
+// VirtualMemoryManager::translate() does: a TLB hit re-reads the PTE.
+std::optional<PhysicalAddress> SharedAddressSpace::translate(TLB& tlb, VirtualAddress vaddr, bool write) {
+    total_accesses_.inc();
+
+    PageNumber vpn = vaddr >> config_.offset_bits;
+    size_t offset = vaddr & ((1ULL << config_.offset_bits) - 1);
+
+    auto cached = tlb.lookup(vpn);
+    if (cached.has_value()) {
+        if (!page_table_.mark_accessed(vpn, write)) {
+            protection_faults_.inc();
+            return std::nullopt;
+        }
+        modelled_cycles_.inc(config_.tlb_hit_cycles);
+        return (cached.value() * config_.page_size) + offset;
+    }
+
+    FrameNumber pfn;
+    auto entry = page_table_.lookup(vpn);
+    if (entry.has_value()) {
+        if (!page_table_.mark_accessed(vpn, write)) {
+            protection_faults_.inc();
+            return std::nullopt;
+        }
+        pfn = entry->frame_number;
+        modelled_cycles_.inc(config_.tlb_hit_cycles + walk_cycles_);
+    } else {
+        const VirtualMemoryArea* vma = vmas_.find(vaddr);
+        if (!vma) {
+            segfaults_.inc();
+            return std::nullopt;
+        }
+        if (!vma->allows(write)) {
+            protection_faults_.inc();
+            return std::nullopt;
+        }
+        auto faulted = handle_page_fault(vpn, vma->protection);
+        if (!faulted.has_value()) {
+            return std::nullopt;
+        }
+        page_table_.mark_accessed(vpn, write);
+        pfn = faulted.value();
+        modelled_cycles_.inc(config_.tlb_hit_cycles + walk_cycles_ + config_.page_fault_cycles);
+    }
+
+    tlb.insert(vpn, pfn);
+    return (pfn * config_.page_size) + offset;
+}
+
+ParallelReplayStats SharedAddressSpace::replay(std::vector<std::unique_ptr<WorkloadGenerator>>& workloads,
+                                               size_t accesses_per_thread) {
+    ParallelReplayStats result;
+    result.threads = workloads.size();
+
+    std::vector<WorkloadRunStats> per_thread(workloads.size());
+    result.tlb_hit_rates.assign(workloads.size(), 0.0);
+    std::vector<std::thread> threads;
+    std::atomic<size_t> ready(0);
+    std::atomic<bool> go(false);
+
+    for (size_t t = 0; t < workloads.size(); ++t) {
+        threads.emplace_back([&, t] {
+            std::unique_ptr<TLB> tlb = create_tlb(t);
+            std::vector<MemoryAccess> batch(4096);
+            WorkloadRunStats& stats = per_thread[t];
+            size_t hits_before = tlb->get_hits();
+            size_t misses_before = tlb->get_misses();
+
+            ready.fetch_add(1, std::memory_order_release);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+
+            while (stats.accesses < accesses_per_thread) {
+                size_t n = workloads[t]->generate(
+                    batch.data(), std::min(batch.size(), accesses_per_thread - stats.accesses));
+                for (size_t i = 0; i < n; ++i) {
+                    if (batch[i].write) {
+                        stats.writes++;
+                    } else {
+                        stats.reads++;
+                    }
+                    if (!translate(*tlb, batch[i].address, batch[i].write).has_value()) {
+                        stats.failed++;
+                    }
+                }
+                stats.accesses += n;
+            }
+
+            size_t hits = tlb->get_hits() - hits_before;
+            size_t lookups = hits + tlb->get_misses() - misses_before;
+            result.tlb_hit_rates[t] = lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+        });
+    }
+
+    while (ready.load(std::memory_order_acquire) < threads.size()) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const auto& stats : per_thread) {
+        result.totals.accesses += stats.accesses;
+        result.totals.reads += stats.reads;
+        result.totals.writes += stats.writes;
+        result.totals.failed += stats.failed;
+    }
+    return result;
+}
+
+std::optional<FrameNumber> SharedAddressSpace::allocate_frame() {
+    FrameNumber pfn = next_frame_.load(std::memory_order_relaxed);
+    do {
+        if (pfn >= config_.num_frames) {
+            return std::nullopt;
+        }
+    } while (!next_frame_.compare_exchange_weak(pfn, pfn + 1, std::memory_order_relaxed));
+    return pfn;
+}
+
+std::optional<FrameNumber> SharedAddressSpace::handle_page_fault(PageNumber vpn, uint8_t protection) {
+    PageTableEntry existing;
+    if (page_table_.claim(vpn, existing) == ClaimResult::AlreadyMapped) {
+        fault_races_.inc();
+        return existing.frame_number;
+    }
+
+    auto pfn = allocate_frame();
+    if (!pfn.has_value()) {
+        page_table_.abandon(vpn);
+        out_of_memory_.inc();
+        return std::nullopt;
+    }
+
+    page_table_.publish(vpn, pfn.value(), protection);
+    page_faults_.inc();
+    return pfn;
+}
+
+} // namespace vm
@@ -2,58 +2,164 @@
 
 namespace vm {
 
-TLB::TLB(size_t capacity)
-    : capacity_(capacity), hits_(0), misses_(0) {}
+TLB::TLB(size_t capacity, std::shared_ptr<MetricsRegistry> metrics, const std::string& name,
+         size_t huge_capacity, size_t huge_shift)
+    : current_asid_(0),
+      huge_shift_(huge_shift),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()),
+      base_(capacity),
+      huge_(huge_capacity) {
+
+    hits_ = metrics_->counter(name + "_hits", "TLB lookups that hit");
+    misses_ = metrics_->counter(name + "_misses", "TLB lookups that missed");
+    huge_hits_ = metrics_->counter(name + "_huge_hits", "TLB lookups that hit a huge page entry");
+    invalidations_ = metrics_->counter(name + "_invalidations", "TLB entries removed by invalidation");
+}
 
 std::optional<FrameNumber> TLB::lookup(PageNumber vpn) {
-    auto it = cache_.find(vpn);
-    if (it != cache_.end()) {
-        hits_++;
-        touch(vpn);
+    auto it = base_.map.find(TlbKey{current_asid_, vpn});
+    if (it != base_.map.end()) {
+        hits_.inc();
+        base_.lru_list.splice(base_.lru_list.begin(), base_.lru_list, it->second.second);
         return it->second.first;
     }
-    misses_++;
+
+    if (!huge_.map.empty()) {
+        auto huge = huge_.map.find(TlbKey{current_asid_, vpn >> huge_shift_});
+        if (huge != huge_.map.end()) {
+            hits_.inc();
+            huge_hits_.inc();
+            huge_.lru_list.splice(huge_.lru_list.begin(), huge_.lru_list, huge->second.second);
+            return huge->second.first + (vpn & ((1ULL << huge_shift_) - 1));
+        }
+    }
+
+    misses_.inc();
     return std::nullopt;
 }
 
 void TLB::insert(PageNumber vpn, FrameNumber pfn) {
-    auto it = cache_.find(vpn);
-
-    if (it != cache_.end()) {
-        it->second.first = pfn;
-        touch(vpn);
-    } else {
-        if (cache_.size() >= capacity_) {
-            PageNumber lru_vpn = lru_list_.back();
-            lru_list_.pop_back();
-            cache_.erase(lru_vpn);
-        }
+    insert_entry(base_, TlbKey{current_asid_, vpn}, pfn);
+}
 
-        lru_list_.push_front(vpn);
-        cache_[vpn] = {pfn, lru_list_.begin()};
+void TLB::insert_huge(PageNumber vpn, FrameNumber base_pfn) {
+    if (huge_.capacity == 0) {
+        insert(vpn, base_pfn + (vpn & ((1ULL << huge_shift_) - 1)));
+        return;
     }
+    insert_entry(huge_, TlbKey{current_asid_, vpn >> huge_shift_}, base_pfn);
 }
 
 void TLB::invalidate(PageNumber vpn) {
-    auto it = cache_.find(vpn);
-    if (it != cache_.end()) {
-        lru_list_.erase(it->second.second);
-        cache_.erase(it);
+    invalidate(current_asid_, vpn);
+}
+
+void TLB::invalidate(Asid asid, PageNumber vpn) {
+    auto it = base_.map.find(TlbKey{asid, vpn});
+    if (it != base_.map.end()) {
+        erase(base_, it);
+        invalidations_.inc();
+    }
+
+    auto huge = huge_.map.find(TlbKey{asid, vpn >> huge_shift_});
+    if (huge != huge_.map.end()) {
+        erase(huge_, huge);
+        invalidations_.inc();
     }
 }
 
+size_t TLB::invalidate_range(PageNumber start, PageNumber end) {
+    return invalidate_range(current_asid_, start, end);
+}
+
+size_t TLB::invalidate_range(Asid asid, PageNumber start, PageNumber end) {
+    if (start >= end || !holds_asid(asid)) {
+        return 0;
+    }
+
+    size_t removed = invalidate_keys(base_, asid, start, end);
+    if (!huge_.map.empty()) {
+        removed += invalidate_keys(huge_, asid, start >> huge_shift_, ((end - 1) >> huge_shift_) + 1);
+    }
+
+    invalidations_.inc(removed);
+    return removed;
+}
+
+size_t TLB::invalidate_asid(Asid asid) {
+    if (!holds_asid(asid)) {
+        return 0;
+    }
+
+    size_t removed = 0;
+    for (EntrySet* set : {&base_, &huge_}) {
+        for (auto lru_it = set->lru_list.begin(); lru_it != set->lru_list.end();) {
+            TlbKey key = *lru_it++;
+            if (key.asid == asid) {
+                erase(*set, set->map.find(key));
+                removed++;
+            }
+        }
+    }
+
+    invalidations_.inc(removed);
+    return removed;
+}
+
 void TLB::clear() {
-    cache_.clear();
-    lru_list_.clear();
+    for (EntrySet* set : {&base_, &huge_}) {
+        set->map.clear();
+        set->lru_list.clear();
+    }
+    asid_entries_.clear();
+}
+
+void TLB::insert_entry(EntrySet& set, TlbKey key, FrameNumber pfn) {
+    auto it = set.map.find(key);
+
+    if (it != set.map.end()) {
+        it->second.first = pfn;
+        set.lru_list.splice(set.lru_list.begin(), set.lru_list, it->second.second);
+    } else {
+        if (set.map.size() >= set.capacity) {
+            erase(set, set.map.find(set.lru_list.back()));
+        }
+
+        set.lru_list.push_front(key);
+        set.map[key] = {pfn, set.lru_list.begin()};
+        asid_entries_[key.asid]++;
+    }
+}
+
+size_t TLB::invalidate_keys(EntrySet& set, Asid asid, PageNumber start, PageNumber end) {
+    size_t removed = 0;
+    if (end - start <= set.map.size()) {
+        for (PageNumber vpn = start; vpn < end; ++vpn) {
+            auto it = set.map.find(TlbKey{asid, vpn});
+            if (it != set.map.end()) {
+                erase(set, it);
+                removed++;
+            }
+        }
+    } else {
+        for (auto lru_it = set.lru_list.begin(); lru_it != set.lru_list.end();) {
+            TlbKey key = *lru_it++;
+            if (key.asid == asid && key.vpn >= start && key.vpn < end) {
+                erase(set, set.map.find(key));
+                removed++;
+            }
+        }
+    }
+    return removed;
 }
 
-void TLB::touch(PageNumber vpn) {
-    auto it = cache_.find(vpn);
-    if (it != cache_.end()) {
-        lru_list_.erase(it->second.second);
-        lru_list_.push_front(vpn);
-        it->second.second = lru_list_.begin();
+void TLB::erase(EntrySet& set, EntryMap::iterator it) {
+    auto count = asid_entries_.find(it->first.asid);
+    if (count != asid_entries_.end() && --count->second == 0) {
+        asid_entries_.erase(count);
     }
+    set.lru_list.erase(it->second.second);
+    set.map.erase(it);
 }
 
 } // namespace vm
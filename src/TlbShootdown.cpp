@@ -0,0 +1,109 @@
+#include "TlbShootdown.h"
+#include <algorithm>
+#include <limits>
+
+namespace vm {
+
+TlbShootdownBatch::TlbShootdownBatch(const Config& config, std::shared_ptr<MetricsRegistry> metrics)
+    : batch_limit_(std::max<size_t>(config.shootdown_batch_limit, 1)),
+      flush_ceiling_(config.tlb_flush_ceiling),
+      ipi_cost_cycles_(config.ipi_cost_cycles),
+      invlpg_cost_cycles_(config.invlpg_cost_cycles),
+      tlb_flush_cost_cycles_(config.tlb_flush_cost_cycles),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()) {
+
+    flushes_ = metrics_->counter("tlb_shootdowns", "Shootdown batches flushed");
+    ranges_queued_ = metrics_->counter("tlb_shootdown_ranges_queued", "Invalidation ranges queued");
+    ranges_flushed_ = metrics_->counter("tlb_shootdown_ranges_flushed",
+                                        "Invalidation ranges sent after coalescing");
+    ipis_ = metrics_->counter("tlb_shootdown_ipis", "Inter-processor interrupts sent");
+    full_flushes_ = metrics_->counter("tlb_shootdown_full_flushes",
+                                      "Remote ASID flushes used instead of per-page invalidation");
+    cycles_ = metrics_->counter("tlb_shootdown_cycles", "Modelled shootdown cost in cycles");
+    ranges_per_flush_ = metrics_->histogram("tlb_shootdown_ranges_per_flush",
+                                            "Coalesced ranges per shootdown batch");
+}
+
+void TlbShootdownBatch::add_range(Asid asid, PageNumber start, PageNumber end) {
+    if (start >= end) {
+        return;
+    }
+    pending_.push_back(InvalidationRange{asid, start, end});
+    ranges_queued_.inc();
+}
+
+void TlbShootdownBatch::add_asid(Asid asid) {
+    add_range(asid, 0, std::numeric_limits<PageNumber>::max());
+}
+
+ShootdownResult TlbShootdownBatch::flush(const std::vector<TLB*>& tlbs, size_t initiator) {
+    ShootdownResult result;
+    if (pending_.empty()) {
+        return result;
+    }
+
+    coalesce();
+    result.ranges = pending_.size();
+
+    for (size_t cpu = 0; cpu < tlbs.size(); ++cpu) {
+        TLB* tlb = tlbs[cpu];
+        if (cpu == initiator || !tlb) {
+            continue;
+        }
+
+        bool targeted = false;
+        for (const auto& range : pending_) {
+            if (tlb->holds_asid(range.asid)) {
+                targeted = true;
+                break;
+            }
+        }
+        if (!targeted) {
+            continue;
+        }
+
+        result.ipis++;
+        result.cycles += ipi_cost_cycles_;
+
+        for (const auto& range : pending_) {
+            if (range.end - range.start > flush_ceiling_) {
+                result.entries_invalidated += tlb->invalidate_asid(range.asid);
+                result.cycles += tlb_flush_cost_cycles_;
+                full_flushes_.inc();
+            } else {
+                result.entries_invalidated += tlb->invalidate_range(range.asid, range.start, range.end);
+                result.cycles += (range.end - range.start) * invlpg_cost_cycles_;
+            }
+        }
+    }
+
+    flushes_.inc();
+    ranges_flushed_.inc(result.ranges);
+    ranges_per_flush_.record(result.ranges);
+    ipis_.inc(result.ipis);
+    cycles_.inc(result.cycles);
+
+    pending_.clear();
+    return result;
+}
+
+void TlbShootdownBatch::coalesce() {
+    std::sort(pending_.begin(), pending_.end(),
+              [](const InvalidationRange& a, const InvalidationRange& b) {
+                  return a.asid != b.asid ? a.asid < b.asid : a.start < b.start;
+              });
+
+    size_t out = 0;
+    for (size_t i = 1; i < pending_.size(); ++i) {
+        InvalidationRange& last = pending_[out];
+        const InvalidationRange& next = pending_[i];
+        if (next.asid == last.asid && next.start <= last.end) {
+            last.end = std::max(last.end, next.end);
+        } else {
+            pending_[++out] = next;
+        }
+    }
+    pending_.resize(out + 1);
+}
+
+} // namespace vm
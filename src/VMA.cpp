@@ -0,0 +1,188 @@
+#include "VMA.h"
+#include <iterator>
+#include <stdexcept>
+
+namespace vm {
+
+namespace {
+
+bool can_merge(const VirtualMemoryArea& lower, const VirtualMemoryArea& upper) {
+    return lower.end == upper.start &&
+           lower.protection == upper.protection &&
+           lower.backing == upper.backing;
+}
+
+} // namespace
+
+const VirtualMemoryArea* VmaTree::find(VirtualAddress addr) const {
+    auto it = areas_.upper_bound(addr);
+    if (it == areas_.begin()) {
+        return nullptr;
+    }
+    --it;
+    return it->second.contains(addr) ? &it->second : nullptr;
+}
+
+bool VmaTree::overlaps(VirtualAddress start, VirtualAddress end) const {
+    auto it = areas_.lower_bound(start);
+    if (it != areas_.end() && it->second.start < end) {
+        return true;
+    }
+    if (it != areas_.begin()) {
+        --it;
+        if (it->second.end > start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VmaTree::is_fully_mapped(VirtualAddress start, VirtualAddress end) const {
+    VirtualAddress cursor = start;
+    while (cursor < end) {
+        const VirtualMemoryArea* vma = find(cursor);
+        if (!vma) {
+            return false;
+        }
+        cursor = vma->end;
+    }
+    return true;
+}
+
+void VmaTree::insert(const VirtualMemoryArea& vma) {
+    if (vma.start >= vma.end) {
+        throw std::invalid_argument("Empty virtual memory area");
+    }
+    if (overlaps(vma.start, vma.end)) {
+        throw std::invalid_argument("Virtual memory area overlaps an existing mapping");
+    }
+
+    areas_[vma.start] = vma;
+    mapped_bytes_ += vma.length();
+    try_merge(vma.start);
+}
+
+std::vector<VirtualMemoryArea> VmaTree::remove_range(VirtualAddress start, VirtualAddress end) {
+    std::vector<VirtualMemoryArea> removed;
+    if (start >= end) {
+        return removed;
+    }
+
+    split_at(start);
+    split_at(end);
+
+    auto it = areas_.lower_bound(start);
+    while (it != areas_.end() && it->second.start < end) {
+        removed.push_back(it->second);
+        mapped_bytes_ -= it->second.length();
+        it = areas_.erase(it);
+    }
+    return removed;
+}
+
+bool VmaTree::protect_range(VirtualAddress start, VirtualAddress end, uint8_t protection) {
+    if (start >= end || !is_fully_mapped(start, end)) {
+        return false;
+    }
+
+    split_at(start);
+    split_at(end);
+
+    for (auto it = areas_.lower_bound(start); it != areas_.end() && it->second.start < end; ++it) {
+        it->second.protection = protection;
+    }
+
+    auto it = areas_.lower_bound(start);
+    if (it != areas_.begin()) {
+        --it;
+    }
+    while (it != areas_.end() && it->second.start <= end) {
+        auto next = std::next(it);
+        if (next != areas_.end() && can_merge(it->second, next->second)) {
+            it->second.end = next->second.end;
+            areas_.erase(next);
+        } else {
+            it = next;
+        }
+    }
+    return true;
+}
+
+std::optional<VirtualAddress> VmaTree::find_free_range(size_t length, VirtualAddress lower,
+                                                       VirtualAddress upper) const {
+    VirtualAddress candidate = lower;
+    auto it = areas_.upper_bound(lower);
+    if (it != areas_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second.end > candidate) {
+            candidate = prev->second.end;
+        }
+    }
+
+    for (; it != areas_.end(); ++it) {
+        if (it->second.start >= candidate && it->second.start - candidate >= length) {
+            break;
+        }
+        if (it->second.end > candidate) {
+            candidate = it->second.end;
+        }
+    }
+
+    if (candidate > upper || upper - candidate < length) {
+        return std::nullopt;
+    }
+    return candidate;
+}
+
+std::vector<VirtualMemoryArea> VmaTree::get_areas() const {
+    std::vector<VirtualMemoryArea> result;
+    result.reserve(areas_.size());
+    for (const auto& entry : areas_) {
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+void VmaTree::clear() {
+    areas_.clear();
+    mapped_bytes_ = 0;
+}
+
+void VmaTree::split_at(VirtualAddress addr) {
+    auto it = areas_.upper_bound(addr);
+    if (it == areas_.begin()) {
+        return;
+    }
+    --it;
+
+    VirtualMemoryArea& vma = it->second;
+    if (vma.start < addr && addr < vma.end) {
+        VirtualMemoryArea upper(addr, vma.end, vma.protection, vma.backing);
+        vma.end = addr;
+        areas_[addr] = upper;
+    }
+}
+
+void VmaTree::try_merge(VirtualAddress start) {
+    auto it = areas_.find(start);
+    if (it == areas_.end()) {
+        return;
+    }
+
+    if (it != areas_.begin()) {
+        auto prev = std::prev(it);
+        if (can_merge(prev->second, it->second)) {
+            prev->second.end = it->second.end;
+            areas_.erase(it);
+            it = prev;
+        }
+    }
+
+    auto next = std::next(it);
+    if (next != areas_.end() && can_merge(it->second, next->second)) {
+        it->second.end = next->second.end;
+        areas_.erase(next);
+    }
+}
+
+} // namespace vm
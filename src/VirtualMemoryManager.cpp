@@ -1,59 +1,177 @@
 #include "VirtualMemoryManager.h"
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
+#include <stdexcept>
 
 namespace vm {
 
-VirtualMemoryManager::VirtualMemoryManager(const Config& config)
+VirtualMemoryManager::VirtualMemoryManager(const Config& config,
+                                           std::shared_ptr<MetricsRegistry> metrics)
     : config_(config),
-      tlb_(std::make_unique<TLB>(config.tlb_size)),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<MetricsRegistry>()),
+      tlb_(nullptr),
+      current_cpu_(0),
       page_table_(std::make_unique<PageTable>(config)),
-      physical_memory_(std::make_unique<PhysicalMemory>(config)),
-      total_accesses_(0),
-      tlb_hits_(0),
-      page_table_hits_(0),
-      page_faults_(0) {}
+      physical_memory_(std::make_unique<PhysicalMemory>(config, metrics_)),
+      shootdown_(config, metrics_),
+      compressed_pool_(std::make_unique<CompressedPool>(*physical_memory_, config.compressed_pool_size,
+                                                        metrics_)),
+      walk_cycles_(config.page_table_levels * config.page_walk_cycles_per_level),
+      huge_walk_cycles_(walk_cycles_ - config.page_walk_cycles_per_level),
+      thp_scan_cursor_(0) {
+
+    compressed_pool_->set_writeback([this] { return writeback_compressed(); });
+
+    if (config.cache_model) {
+        caches_ = std::make_unique<CacheHierarchy>(CacheHierarchy::levels_from_config(config),
+                                                   config.memory_access_cycles, metrics_);
+    }
+
+    size_t num_cpus = config.num_cpus > 0 ? config.num_cpus : 1;
+    size_t huge_shift = config.page_table_levels > 1 ? config.bits_per_level : 0;
+    for (size_t cpu = 0; cpu < num_cpus; ++cpu) {
+        tlbs_.push_back(std::make_unique<TLB>(config.tlb_size, metrics_,
+                                              "tlb_cpu" + std::to_string(cpu),
+                                              huge_shift > 0 ? config.huge_tlb_size : 0, huge_shift));
+    }
+    tlb_ = tlbs_.front().get();
+
+    total_accesses_ = metrics_->counter("memory_accesses", "Virtual address translations requested");
+    page_table_hits_ = metrics_->counter("page_table_hits", "TLB misses resolved by a page table walk");
+    page_faults_ = metrics_->counter("page_faults", "Translations that required a page fault");
+    segfaults_ = metrics_->counter("segfaults", "Faults on addresses outside any mapped area");
+    protection_faults_ = metrics_->counter("protection_faults", "Accesses denied by page protection");
+    pages_unmapped_ = metrics_->counter("pages_unmapped", "Resident pages released by munmap");
+    evictions_ = metrics_->counter("evictions", "Resident pages evicted to make room");
+    same_filled_evictions_ = metrics_->counter("evictions_same_filled",
+                                               "Evicted pages stored as a single fill byte");
+    swap_outs_ = metrics_->counter("swap_outs", "Evicted pages written to swap");
+    swap_ins_ = metrics_->counter("swap_ins", "Faults served from swap");
+    compressed_faults_ = metrics_->counter("compressed_faults", "Faults served from the compressed pool");
+    modelled_cycles_ = metrics_->counter("modelled_cycles", "Modelled translation and fault cost");
+    prereclaimed_faults_ = metrics_->counter("faults_prereclaimed",
+                                             "Faults served from frames freed by background reclaim");
+    direct_reclaim_faults_ = metrics_->counter("faults_direct_reclaim",
+                                               "Faults that stalled in direct reclaim");
+    background_reclaimed_ = metrics_->counter("pages_reclaimed_background",
+                                              "Pages evicted by the background reclaim daemon");
+    direct_reclaimed_ = metrics_->counter("pages_reclaimed_direct", "Pages evicted by direct reclaim");
+    background_reclaim_cycles_ = metrics_->counter("background_reclaim_cycles",
+                                                   "Modelled cost of background reclaim");
+    thp_ranges_scanned_ = metrics_->counter("thp_ranges_scanned", "Huge-page-sized ranges scanned for collapse");
+    thp_promotions_ = metrics_->counter("thp_promotions", "Ranges collapsed into a huge mapping");
+    thp_promotions_in_place_ = metrics_->counter("thp_promotions_in_place",
+                                                 "Collapses whose frames were already contiguous");
+    thp_collapse_failures_ = metrics_->counter("thp_collapse_failures",
+                                               "Eligible ranges left unpromoted for lack of a free huge frame run");
+    thp_pages_copied_ = metrics_->counter("thp_pages_copied", "Base pages copied into a huge frame run");
+    thp_collapse_cycles_ = metrics_->counter("thp_collapse_cycles", "Modelled cost of copying during collapse");
+    thp_demotions_ = metrics_->counter("thp_demotions", "Huge mappings split under memory pressure");
+    fault_cycles_ = metrics_->histogram("fault_cycles", "Modelled cost of each page fault");
+    direct_reclaim_stall_cycles_ = metrics_->histogram("direct_reclaim_stall_cycles",
+                                                       "Modelled stall of each direct reclaim");
+
+    if (config.background_reclaim) {
+        reclaimd_ = std::make_unique<BackgroundWorker>([this] { return background_reclaim(); });
+        reclaimd_->start();
+    }
+    if (config.transparent_huge_pages && config.thp_background_scan &&
+        page_table_->get_huge_page_pages() > 0) {
+        khugepaged_ = std::make_unique<BackgroundWorker>(
+            [this] { return collapse_huge_pages(config_.thp_scan_ranges); });
+        khugepaged_->start();
+    }
+}
+
+VirtualMemoryManager::~VirtualMemoryManager() {
+    if (khugepaged_) {
+        khugepaged_->stop();
+    }
+    if (reclaimd_) {
+        reclaimd_->stop();
+    }
+}
 
 std::optional<PhysicalAddress> VirtualMemoryManager::translate(VirtualAddress vaddr, bool write) {
-    total_accesses_++;
+    auto lock = lock_mm();
+    return translate_locked(vaddr, write);
+}
+
+std::optional<PhysicalAddress> VirtualMemoryManager::translate_locked(VirtualAddress vaddr, bool write) {
+    total_accesses_.inc();
 
     PageNumber vpn = extract_page_number(vaddr);
     size_t offset = extract_offset(vaddr);
 
+    uint8_t required = write ? kProtWrite : kProtRead;
+
     auto tlb_result = tlb_->lookup(vpn);
     if (tlb_result.has_value()) {
-        tlb_hits_++;
         FrameNumber pfn = tlb_result.value();
 
-        if (write) {
-            page_table_->set_dirty(vpn, true);
+        PageTableEntry* entry = page_table_->get_entry(vpn);
+        if (entry && entry->valid) {
+            if (!(entry->protection & required)) {
+                protection_faults_.inc();
+                return std::nullopt;
+            }
+            if (write) {
+                entry->dirty = true;
+            }
+            entry->referenced = true;
         }
-        page_table_->set_referenced(vpn, true);
 
+        modelled_cycles_.inc(config_.tlb_hit_cycles);
         PhysicalAddress paddr = (pfn * config_.page_size) + offset;
         return paddr;
     }
 
-    auto pt_result = page_table_->translate(vpn);
-    if (pt_result.has_value()) {
-        page_table_hits_++;
-        FrameNumber pfn = pt_result.value();
+    PageTableEntry* entry = page_table_->get_entry(vpn);
+    if (entry && entry->valid) {
+        if (!(entry->protection & required)) {
+            protection_faults_.inc();
+            return std::nullopt;
+        }
 
-        tlb_->insert(vpn, pfn);
+        page_table_hits_.inc();
+        FrameNumber pfn = page_table_->frame_for(*entry, vpn);
+        entry->referenced = true;
+
+        if (entry->huge) {
+            tlb_->insert_huge(vpn, entry->frame_number);
+        } else {
+            tlb_->insert(vpn, pfn);
+        }
 
         if (write) {
-            page_table_->set_dirty(vpn, true);
+            entry->dirty = true;
         }
 
+        modelled_cycles_.inc(config_.tlb_hit_cycles + (entry->huge ? huge_walk_cycles_ : walk_cycles_));
         PhysicalAddress paddr = (pfn * config_.page_size) + offset;
         return paddr;
     }
 
-    page_faults_++;
-    if (!handle_page_fault(vpn)) {
+    const VirtualMemoryArea* vma = vmas_.find(vaddr);
+    if (!vma) {
+        segfaults_.inc();
+        return std::nullopt;
+    }
+    if (!vma->allows(write)) {
+        protection_faults_.inc();
+        return std::nullopt;
+    }
+
+    page_faults_.inc();
+    uint64_t cycles = config_.tlb_hit_cycles + walk_cycles_ + config_.page_fault_cycles;
+    if (!handle_page_fault(vpn, vma->protection, cycles)) {
         return std::nullopt;
     }
+    modelled_cycles_.inc(cycles);
+    fault_cycles_.record(cycles);
 
-    pt_result = page_table_->translate(vpn);
+    auto pt_result = page_table_->translate(vpn);
     if (pt_result.has_value()) {
         FrameNumber pfn = pt_result.value();
         tlb_->insert(vpn, pfn);
@@ -69,8 +187,139 @@ std::optional<PhysicalAddress> VirtualMemoryManager::translate(VirtualAddress va
     return std::nullopt;
 }
 
+std::optional<PhysicalAddress> VirtualMemoryManager::access(VirtualAddress vaddr, bool write) {
+    auto lock = lock_mm();
+    auto paddr = translate(vaddr, write);
+    if (paddr.has_value() && caches_) {
+        modelled_cycles_.inc(caches_->access(paddr.value(), write));
+    }
+    return paddr;
+}
+
+// segments holds the run's R/W segment lengths (see PageRun) and may be null
+// when the run has no toggles.
+size_t VirtualMemoryManager::access_run(const PageRun& run, const uint32_t* segments) {
+    auto lock = lock_mm();
+    return access_run_locked(run, segments);
+}
+
+// Replays a decoded chunk under one acquisition of the mm lock.
+size_t VirtualMemoryManager::access_runs(const PageRunChunk& chunk) {
+    auto lock = lock_mm();
+    size_t failed = 0;
+    for (const auto& run : chunk.runs) {
+        failed += access_run_locked(run, chunk.segments_of(run));
+    }
+    return failed;
+}
+
+size_t VirtualMemoryManager::access_run_locked(const PageRun& run, const uint32_t* segments) {
+    if (run.length == 0) {
+        return 0;
+    }
+
+    VirtualAddress vaddr = run.vpn << config_.offset_bits;
+    size_t remaining = run.length - 1;
+    size_t remaining_writes = run.writes - (run.first_write ? 1 : 0);
+
+    if (!translate_locked(vaddr, run.first_write).has_value()) {
+        // The page did not become accessible, so each access may fault on
+        // its own; replay them in their recorded order.
+        size_t failed = 1;
+        bool first = true;
+        for_each_run_segment(run, segments, [&](bool write, uint32_t count) {
+            for (uint32_t i = first ? 1 : 0; i < count; ++i) {
+                if (!translate_locked(vaddr, write).has_value()) {
+                    failed++;
+                }
+            }
+            first = false;
+        });
+        return failed;
+    }
+    if (remaining == 0) {
+        return 0;
+    }
+
+    // The first access left the page resident and in the TLB, so the rest of
+    // the run are TLB hits that only differ in their protection check.
+    total_accesses_.inc(remaining);
+    tlb_->record_hits(remaining);
+
+    size_t denied = 0;
+    if (remaining_writes > 0) {
+        PageTableEntry* entry = page_table_->get_entry(run.vpn);
+        if (entry->protection & kProtWrite) {
+            entry->dirty = true;
+        } else {
+            denied = remaining_writes;
+            protection_faults_.inc(denied);
+        }
+    }
+    modelled_cycles_.inc((remaining - denied) * config_.tlb_hit_cycles);
+    return denied;
+}
+
+FastForwardResult VirtualMemoryManager::fast_forward(const MemoryAccess* accesses, size_t count) {
+    auto lock = lock_mm();
+
+    // Functional-only replay: faults pages in and keeps the reference and
+    // dirty bits that drive victim selection current, but leaves the TLB,
+    // caches and access statistics untouched. Faults are still reported, with
+    // the cost translate() would have charged, since residency is exact here.
+    //
+    // Only the first touch (and first write) of a page needs a page-table
+    // walk. Repeat touches hit a small direct-mapped cache of entries. Only a
+    // fault can evict, split or clear a reference bit while the mm lock is
+    // held, so each fault starts a new epoch that invalidates the cache.
+    struct Touched {
+        PageNumber vpn;
+        PageTableEntry* entry;
+        uint32_t epoch;
+        bool wrote;
+    };
+    constexpr size_t kTouchedSlots = 1024;
+    std::vector<Touched> touched(kTouchedSlots, Touched{0, nullptr, 0, false});
+    uint32_t epoch = 1;
+
+    FastForwardResult result;
+    for (size_t i = 0; i < count; ++i) {
+        PageNumber vpn = extract_page_number(accesses[i].address);
+        bool write = accesses[i].write;
+        Touched& slot = touched[vpn & (kTouchedSlots - 1)];
+        if (slot.epoch == epoch && slot.vpn == vpn && (slot.wrote || !write)) {
+            continue;
+        }
+
+        PageTableEntry* entry = slot.epoch == epoch && slot.vpn == vpn ? slot.entry
+                                                                       : page_table_->get_entry(vpn);
+        if (!entry || !entry->valid) {
+            const VirtualMemoryArea* vma = vmas_.find(accesses[i].address);
+            if (!vma || !vma->allows(write)) {
+                continue;
+            }
+            uint64_t cycles = config_.tlb_hit_cycles + walk_cycles_ + config_.page_fault_cycles;
+            if (!handle_page_fault(vpn, vma->protection, cycles)) {
+                continue;
+            }
+            epoch++;
+            entry = page_table_->get_entry(vpn);
+            result.faults++;
+            result.fault_cycles += cycles;
+        }
+
+        entry->referenced = true;
+        if (write && (entry->protection & kProtWrite)) {
+            entry->dirty = true;
+        }
+        slot = Touched{vpn, entry, epoch, write};
+    }
+    return result;
+}
+
 uint8_t VirtualMemoryManager::read_byte(VirtualAddress vaddr) {
-    auto paddr = translate(vaddr, false);
+    auto lock = lock_mm();
+    auto paddr = access(vaddr, false);
     if (!paddr.has_value()) {
         throw std::runtime_error("Failed to translate virtual address for read");
     }
@@ -78,7 +327,8 @@ uint8_t VirtualMemoryManager::read_byte(VirtualAddress vaddr) {
 }
 
 void VirtualMemoryManager::write_byte(VirtualAddress vaddr, uint8_t value) {
-    auto paddr = translate(vaddr, true);
+    auto lock = lock_mm();
+    auto paddr = access(vaddr, true);
     if (!paddr.has_value()) {
         throw std::runtime_error("Failed to translate virtual address for write");
     }
@@ -86,29 +336,168 @@ void VirtualMemoryManager::write_byte(VirtualAddress vaddr, uint8_t value) {
 }
 
 bool VirtualMemoryManager::allocate_page(VirtualAddress vaddr) {
+    auto lock = lock_mm();
     PageNumber vpn = extract_page_number(vaddr);
 
     if (page_table_->is_present(vpn)) {
         return true;
     }
 
-    return handle_page_fault(vpn);
+    const VirtualMemoryArea* vma = vmas_.find(vaddr);
+    if (!vma) {
+        VirtualAddress page_start = vpn << config_.offset_bits;
+        if (!mmap(page_start, config_.page_size, kProtRead | kProtWrite,
+                  VmaBacking::Anonymous, true)) {
+            return false;
+        }
+        vma = vmas_.find(vaddr);
+    }
+
+    uint64_t cycles = 0;
+    return handle_page_fault(vpn, vma->protection, cycles);
 }
 
 void VirtualMemoryManager::free_page(VirtualAddress vaddr) {
+    auto lock = lock_mm();
     PageNumber vpn = extract_page_number(vaddr);
 
     auto entry = page_table_->get_entry(vpn);
+    if (entry && entry->valid && entry->huge) {
+        split_huge_page(vpn);
+        entry = page_table_->get_entry(vpn);
+    }
     if (entry && entry->valid) {
         FrameNumber pfn = entry->frame_number;
 
         page_table_->invalidate(vpn);
         tlb_->invalidate(vpn);
+        queue_invalidation(vpn, vpn + 1);
+        deferred_frees_.push_back(pfn);
+
+        if (tlbs_.size() == 1 || shootdown_.should_flush()) {
+            flush_tlb_shootdowns();
+        }
+    }
+    discard_evicted(vpn, vpn + 1);
+}
+
+std::optional<VirtualAddress> VirtualMemoryManager::mmap(VirtualAddress addr, size_t length,
+                                                        uint8_t protection, VmaBacking backing,
+                                                        bool fixed) {
+    auto lock = lock_mm();
+    if (length == 0 || addr % config_.page_size != 0) {
+        return std::nullopt;
+    }
+
+    size_t aligned_length = page_align_up(length);
+    VirtualAddress limit = address_space_limit();
+
+    if (fixed) {
+        if (addr > limit || limit - addr < aligned_length) {
+            return std::nullopt;
+        }
+        if (vmas_.overlaps(addr, addr + aligned_length)) {
+            munmap(addr, aligned_length);
+        }
+    } else {
+        VirtualAddress lower = addr != 0 ? addr : config_.page_size;
+        auto found = vmas_.find_free_range(aligned_length, lower, limit);
+        if (!found.has_value() && addr != 0) {
+            found = vmas_.find_free_range(aligned_length, config_.page_size, limit);
+        }
+        if (!found.has_value()) {
+            return std::nullopt;
+        }
+        addr = found.value();
+    }
+
+    vmas_.insert(VirtualMemoryArea(addr, addr + aligned_length, protection, backing));
+    return addr;
+}
+
+bool VirtualMemoryManager::munmap(VirtualAddress addr, size_t length) {
+    auto lock = lock_mm();
+    if (length == 0 || addr % config_.page_size != 0) {
+        return false;
+    }
+
+    VirtualAddress end = addr + page_align_up(length);
+    vmas_.remove_range(addr, end);
+
+    std::vector<std::pair<PageNumber, FrameNumber>> unmapped;
+    page_table_->unmap_range(extract_page_number(addr), extract_page_number(end), unmapped);
+    discard_evicted(extract_page_number(addr), extract_page_number(end));
+
+    if (!unmapped.empty()) {
+        PageNumber start_vpn = extract_page_number(addr);
+        PageNumber end_vpn = extract_page_number(end);
+        tlb_->invalidate_range(start_vpn, end_vpn);
+        queue_invalidation(start_vpn, end_vpn);
+
+        for (const auto& mapping : unmapped) {
+            deferred_frees_.push_back(mapping.second);
+        }
+        flush_tlb_shootdowns();
+    }
+    pages_unmapped_.inc(unmapped.size());
+
+    return true;
+}
+
+bool VirtualMemoryManager::mprotect(VirtualAddress addr, size_t length, uint8_t protection) {
+    auto lock = lock_mm();
+    if (length == 0 || addr % config_.page_size != 0) {
+        return false;
+    }
+
+    VirtualAddress end = addr + page_align_up(length);
+    if (!vmas_.protect_range(addr, end, protection)) {
+        return false;
+    }
+
+    PageNumber start_vpn = extract_page_number(addr);
+    PageNumber end_vpn = extract_page_number(end);
+    if (page_table_->protect_range(start_vpn, end_vpn, protection) > 0) {
+        tlb_->invalidate_range(start_vpn, end_vpn);
+        queue_invalidation(start_vpn, end_vpn);
+        flush_tlb_shootdowns();
+    }
+    return true;
+}
+
+ShootdownResult VirtualMemoryManager::flush_tlb_shootdowns() {
+    auto lock = lock_mm();
+    std::vector<TLB*> tlbs;
+    tlbs.reserve(tlbs_.size());
+    for (const auto& tlb : tlbs_) {
+        tlbs.push_back(tlb.get());
+    }
+
+    ShootdownResult result = shootdown_.flush(tlbs, current_cpu_);
+
+    for (FrameNumber pfn : deferred_frees_) {
         physical_memory_->free_frame(pfn);
     }
+    deferred_frees_.clear();
+    for (FrameNumber pfn : reclaimed_frees_) {
+        physical_memory_->free_frame(pfn, true);
+    }
+    reclaimed_frees_.clear();
+
+    return result;
+}
+
+void VirtualMemoryManager::set_cpu(size_t cpu) {
+    auto lock = lock_mm();
+    if (cpu >= tlbs_.size()) {
+        throw std::out_of_range("Invalid CPU index");
+    }
+    current_cpu_ = cpu;
+    tlb_ = tlbs_[cpu].get();
 }
 
 void VirtualMemoryManager::print_statistics(std::ostream& os) const {
+    auto lock = lock_mm();
     os << "\n========== Virtual Memory Manager Statistics ==========\n";
     os << std::fixed << std::setprecision(2);
 
@@ -120,40 +509,142 @@ void VirtualMemoryManager::print_statistics(std::ostream& os) const {
     os << "  Number of frames: " << config_.num_frames << "\n";
     os << "  Page table levels: " << config_.page_table_levels << "\n";
     os << "  TLB size: " << config_.tlb_size << " entries\n";
+    os << "  CPUs: " << tlbs_.size() << "\n";
 
     os << "\nMemory Access Statistics:\n";
-    os << "  Total memory accesses: " << total_accesses_ << "\n";
-    os << "  TLB hits: " << tlb_hits_ << "\n";
-    os << "  Page table hits: " << page_table_hits_ << "\n";
-    os << "  Page faults: " << page_faults_ << "\n";
+    size_t total_accesses = get_total_accesses();
+    size_t tlb_hits = get_tlb_hits();
+    size_t page_table_hits = get_page_table_hits();
+    size_t page_faults = get_page_faults();
 
-    if (total_accesses_ > 0) {
-        double tlb_hit_rate = static_cast<double>(tlb_hits_) / total_accesses_ * 100.0;
-        double pt_hit_rate = static_cast<double>(page_table_hits_) / total_accesses_ * 100.0;
-        double fault_rate = static_cast<double>(page_faults_) / total_accesses_ * 100.0;
+    os << "  Total memory accesses: " << total_accesses << "\n";
+    os << "  TLB hits: " << tlb_hits << "\n";
+    os << "  Page table hits: " << page_table_hits << "\n";
+    os << "  Page faults: " << page_faults << "\n";
+    os << "  Segmentation faults: " << get_segfaults() << "\n";
+    os << "  Protection faults: " << get_protection_faults() << "\n";
+
+    if (total_accesses > 0) {
+        double tlb_hit_rate = static_cast<double>(tlb_hits) / total_accesses * 100.0;
+        double pt_hit_rate = static_cast<double>(page_table_hits) / total_accesses * 100.0;
+        double fault_rate = static_cast<double>(page_faults) / total_accesses * 100.0;
 
         os << "\nHit Rates:\n";
         os << "  TLB hit rate: " << tlb_hit_rate << "%\n";
+        if (tlbs_.size() > 1) {
+            os << "  Per-CPU TLB hit rate:";
+            for (size_t cpu = 0; cpu < tlbs_.size(); ++cpu) {
+                os << " cpu" << cpu << " " << tlbs_[cpu]->get_hit_rate() * 100.0 << "%";
+            }
+            os << "\n";
+        }
         os << "  Page table hit rate: " << pt_hit_rate << "%\n";
         os << "  Page fault rate: " << fault_rate << "%\n";
     }
 
+    if (shootdown_.get_flushes() > 0) {
+        os << "\nTLB Shootdowns:\n";
+        os << "  Batches flushed: " << shootdown_.get_flushes() << "\n";
+        os << "  IPIs sent: " << shootdown_.get_ipis() << "\n";
+        os << "  Modelled cost: " << shootdown_.get_cycles() << " cycles\n";
+    }
+
+    if (get_evictions() > 0) {
+        os << "\nReclaim and Compression:\n";
+        os << "  Evictions: " << get_evictions() << "\n";
+        os << "  Same-filled pages: " << same_filled_evictions_.value() << "\n";
+        os << "  Compressed pool: " << compressed_pool_->get_stored_pages() << " pages in "
+           << compressed_pool_->get_used_pages() << " / " << compressed_pool_->get_capacity_pages()
+           << " pool frames (ratio " << compressed_pool_->get_compression_ratio() << ", "
+           << compressed_pool_->get_writebacks() << " written back to swap)\n";
+        os << "  Faults from compressed pool: " << compressed_faults_.value() << "\n";
+        os << "  Swap outs / ins: " << swap_outs_.value() << " / " << swap_ins_.value() << "\n";
+        os << "  Mean fault cost: " << fault_cycles_.mean() << " cycles (p99 "
+           << fault_cycles_.percentile(0.99) << ")\n";
+        os << "  Faults from pre-reclaimed frames: " << get_prereclaimed_faults() << "\n";
+        os << "  Faults stalled in direct reclaim: " << get_direct_reclaim_faults() << "\n";
+        os << "  Pages reclaimed (background / direct): " << get_background_reclaimed_pages()
+           << " / " << get_direct_reclaimed_pages() << "\n";
+    }
+
+    if (reclaimd_) {
+        os << "\nBackground Reclaim:\n";
+        os << "  Watermarks (min / low / high): " << config_.min_free_frames << " / "
+           << config_.low_free_frames << " / " << config_.high_free_frames << " frames\n";
+        os << "  Daemon wakeups: " << reclaimd_->get_wakeups() << "\n";
+        os << "  Modelled cost: " << background_reclaim_cycles_.value() << " cycles\n";
+    }
+
+    if (khugepaged_ || get_huge_promotions() > 0) {
+        size_t promotions = get_huge_promotions();
+        size_t attempts = promotions + get_huge_collapse_failures();
+        os << "\nTransparent Huge Pages:\n";
+        os << "  Ranges scanned: " << thp_ranges_scanned_.value() << "\n";
+        os << "  Promotions: " << promotions << " (" << get_huge_promotions_in_place()
+           << " in place), success rate "
+           << (attempts > 0 ? static_cast<double>(promotions) / attempts * 100.0 : 0.0) << "%\n";
+        os << "  Pages copied: " << get_huge_pages_copied() << " (" << get_huge_collapse_cycles()
+           << " cycles)\n";
+        os << "  Demotions under pressure: " << get_huge_demotions() << "\n";
+        os << "  Huge mappings: " << get_huge_mappings() << ", huge TLB hits: "
+           << get_tlb_huge_hits() << "\n";
+    }
+
+    if (caches_) {
+        os << "\nData Caches:\n";
+        for (size_t level = 0; level < caches_->get_num_levels(); ++level) {
+            const Cache& cache = caches_->get_level(level);
+            os << "  " << cache.get_name() << ": " << cache.get_accesses() << " accesses, "
+               << cache.get_miss_rate() * 100.0 << "% miss rate, " << cache.get_writebacks()
+               << " writebacks\n";
+        }
+        os << "  Memory reads / writes: " << caches_->get_memory_reads() << " / "
+           << caches_->get_memory_writes() << " lines\n";
+        if (physical_memory_->get_num_colours() > 1) {
+            os << "  Page colours: " << physical_memory_->get_num_colours() << " ("
+               << physical_memory_->get_colour_fallbacks() << " fallbacks)\n";
+        }
+    }
+
     os << "\nMemory Usage:\n";
     os << "  Allocated frames: " << physical_memory_->get_allocated_frames()
        << " / " << physical_memory_->get_num_frames() << "\n";
     os << "  Free frames: " << physical_memory_->get_free_frames() << "\n";
     os << "  Page table entries: " << page_table_->get_num_entries() << "\n";
+    os << "  Page table nodes: " << page_table_->get_num_nodes() << "\n";
+    os << "  Mapped areas: " << vmas_.get_num_areas() << " ("
+       << (vmas_.get_mapped_bytes() / 1024) << " KB)\n";
 
     os << "======================================================\n\n";
 }
 
+size_t VirtualMemoryManager::get_tlb_hits() const {
+    size_t hits = 0;
+    for (const auto& tlb : tlbs_) {
+        hits += tlb->get_hits();
+    }
+    return hits;
+}
+
+size_t VirtualMemoryManager::get_tlb_misses() const {
+    size_t misses = 0;
+    for (const auto& tlb : tlbs_) {
+        misses += tlb->get_misses();
+    }
+    return misses;
+}
+
+size_t VirtualMemoryManager::get_tlb_huge_hits() const {
+    size_t hits = 0;
+    for (const auto& tlb : tlbs_) {
+        hits += tlb->get_huge_hits();
+    }
+    return hits;
+}
+
 void VirtualMemoryManager::reset_statistics() {
-    total_accesses_ = 0;
-    tlb_hits_ = 0;
-    page_table_hits_ = 0;
-    page_faults_ = 0;
-    tlb_->reset_stats();
-    physical_memory_->reset_stats();
+    auto lock = lock_mm();
+    metrics_->reset();
 }
 
 PageNumber VirtualMemoryManager::extract_page_number(VirtualAddress vaddr) const {
@@ -165,15 +656,420 @@ size_t VirtualMemoryManager::extract_offset(VirtualAddress vaddr) const {
     return vaddr & mask;
 }
 
-bool VirtualMemoryManager::handle_page_fault(PageNumber vpn) {
+VirtualAddress VirtualMemoryManager::address_space_limit() const {
+    if (config_.virtual_address_bits >= 64) {
+        return ~0ULL;
+    }
+    return 1ULL << config_.virtual_address_bits;
+}
+
+size_t VirtualMemoryManager::page_align_up(size_t length) const {
+    return (length + config_.page_size - 1) / config_.page_size * config_.page_size;
+}
+
+std::unique_lock<std::recursive_mutex> VirtualMemoryManager::lock_mm() const {
+    if (!reclaimd_ && !khugepaged_) {
+        return std::unique_lock<std::recursive_mutex>(mm_mutex_, std::defer_lock);
+    }
+    return std::unique_lock<std::recursive_mutex>(mm_mutex_);
+}
+
+void VirtualMemoryManager::queue_invalidation(PageNumber start, PageNumber end) {
+    if (tlbs_.size() > 1) {
+        shootdown_.add_range(tlb_->get_asid(), start, end);
+    }
+}
+
+bool VirtualMemoryManager::handle_page_fault(PageNumber vpn, uint8_t protection, uint64_t& cycles) {
+    bool direct_reclaim = false;
+    if (!ensure_free_frame(cycles, direct_reclaim)) {
+        return false;
+    }
+
     auto pfn = physical_memory_->allocate_frame(vpn);
     if (!pfn.has_value()) {
         return false;
     }
 
-    page_table_->insert(vpn, pfn.value());
+    if (direct_reclaim) {
+        direct_reclaim_faults_.inc();
+    } else if (physical_memory_->get_frame(pfn.value()).reclaimed) {
+        prereclaimed_faults_.inc();
+    }
+
+    auto evicted = evicted_pages_.find(vpn);
+    if (evicted != evicted_pages_.end()) {
+        cycles += restore_page(vpn, pfn.value());
+    } else {
+        physical_memory_->zero_frame(pfn.value());
+    }
+
+    page_table_->insert(vpn, pfn.value(), protection);
+    if (khugepaged_ && physical_memory_->get_free_frames() >= config_.high_free_frames) {
+        khugepaged_->wake();
+    }
+
+    return true;
+}
+
+// Faults leave a few frames free for the compressed pool, which needs a slab
+// frame in hand while reclaim is compressing the page it is about to free.
+bool VirtualMemoryManager::ensure_free_frame(uint64_t& cycles, bool& direct_reclaim) {
+    size_t reserve = compressed_pool_->is_enabled() ? CompressedPool::kMaxPagesPerSlab : 0;
+    if (physical_memory_->get_free_frames() <= reserve && !deferred_frees_.empty()) {
+        flush_tlb_shootdowns();
+    }
+
+    size_t free_frames = physical_memory_->get_free_frames();
+    size_t batch = 1;
+    if (reclaimd_) {
+        if (free_frames < config_.low_free_frames) {
+            reclaimd_->wake();
+        }
+        if (free_frames > reserve && free_frames >= config_.min_free_frames) {
+            return true;
+        }
+        batch = std::max<size_t>(config_.reclaim_batch_size, 1);
+    } else if (free_frames > reserve) {
+        return true;
+    } else {
+        batch = reserve + 1 - free_frames;
+    }
+
+    uint64_t stall = 0;
+    size_t reclaimed = reclaim_pages(batch, false, stall);
+    if (physical_memory_->get_free_frames() == 0) {
+        return false;
+    }
+
+    if (reclaimed > 0) {
+        direct_reclaim = true;
+        direct_reclaim_stall_cycles_.record(stall);
+        cycles += stall;
+    }
+    return true;
+}
+
+size_t VirtualMemoryManager::reclaim_pages(size_t count, bool background, uint64_t& cycles) {
+    size_t reclaimed = 0;
+    while (reclaimed < count) {
+        auto victim = select_victim();
+        if (!victim.has_value()) {
+            break;
+        }
+        cycles += evict_page(victim.value(), background);
+        reclaimed++;
+    }
+
+    if (reclaimed > 0) {
+        flush_tlb_shootdowns();
+        (background ? background_reclaimed_ : direct_reclaimed_).inc(reclaimed);
+    }
+    return reclaimed;
+}
+
+// Called on every wakeup and poll: reclaim starts only below the low
+// watermark and then continues up to the high watermark.
+size_t VirtualMemoryManager::background_reclaim() {
+    size_t total = 0;
+    size_t start = config_.low_free_frames;
+    while (true) {
+        std::lock_guard<std::recursive_mutex> lock(mm_mutex_);
+        size_t free_frames = physical_memory_->get_free_frames();
+        if (free_frames >= start) {
+            break;
+        }
+        start = config_.high_free_frames;
+
+        size_t batch = std::min(std::max<size_t>(config_.reclaim_batch_size, 1),
+                                config_.high_free_frames - free_frames);
+        uint64_t cycles = 0;
+        size_t reclaimed = reclaim_pages(batch, true, cycles);
+        background_reclaim_cycles_.inc(cycles);
+        if (reclaimed == 0) {
+            break;
+        }
+        total += reclaimed;
+    }
+    return total;
+}
+
+std::optional<FrameNumber> VirtualMemoryManager::select_victim() {
+    size_t budget = 2 * physical_memory_->get_num_frames();
+    for (size_t scanned = 0; scanned < budget; ++scanned) {
+        auto candidate = physical_memory_->next_victim_candidate();
+        if (!candidate.has_value()) {
+            return std::nullopt;
+        }
+
+        PageNumber owner = physical_memory_->get_frame(candidate.value()).owner_vpn;
+        PageTableEntry* entry = page_table_->get_entry(owner);
+        if (entry && entry->valid && entry->huge) {
+            // A huge mapping gets one second chance per clock pass, at its
+            // first frame. If still cold it is split and its base pages
+            // become ordinary victims.
+            if (entry->frame_number != candidate.value()) {
+                continue;
+            }
+            if (entry->referenced) {
+                entry->referenced = false;
+                continue;
+            }
+            split_huge_page(owner);
+            thp_demotions_.inc();
+            entry = page_table_->get_entry(owner);
+        }
+        if (!entry || !entry->valid || entry->frame_number != candidate.value()) {
+            continue;
+        }
+        if (entry->referenced) {
+            entry->referenced = false;
+            continue;
+        }
+        return candidate;
+    }
+    return std::nullopt;
+}
+
+size_t VirtualMemoryManager::collapse_huge_pages(size_t max_ranges) {
+    auto lock = lock_mm();
+    uint64_t cycles = 0;
+    size_t promoted = 0;
+    std::optional<PageNumber> first;
+    for (size_t scanned = 0; scanned < max_ranges; ++scanned) {
+        // A pass visits each range at most once, so a refused range is
+        // counted once however few candidates there are.
+        auto base = next_huge_candidate();
+        if (!base.has_value() || base == first) {
+            break;
+        }
+        if (!first.has_value()) {
+            first = base;
+        }
+        thp_ranges_scanned_.inc();
+        CollapseResult result = collapse_range(base.value(), cycles);
+        if (result == CollapseResult::Promoted) {
+            promoted++;
+        } else if (result == CollapseResult::Refused) {
+            break;
+        }
+    }
+
+    if (promoted > 0) {
+        flush_tlb_shootdowns();
+        thp_collapse_cycles_.inc(cycles);
+    }
+    return promoted;
+}
+
+std::optional<PageNumber> VirtualMemoryManager::next_huge_candidate() {
+    PageNumber span = page_table_->get_huge_page_pages();
+    if (span == 0) {
+        return std::nullopt;
+    }
+
+    // Walk the huge-aligned ranges that lie wholly inside a VMA, resuming
+    // where the previous scan stopped and wrapping once at the top.
+    for (int pass = 0; pass < 2; ++pass) {
+        for (const auto& vma : vmas_.get_areas()) {
+            PageNumber first = (extract_page_number(vma.start) + span - 1) / span * span;
+            PageNumber cursor = (thp_scan_cursor_ + span - 1) / span * span;
+            first = std::max(first, cursor);
+            if (first + span <= extract_page_number(vma.end)) {
+                thp_scan_cursor_ = first + span;
+                return first;
+            }
+        }
+        thp_scan_cursor_ = 0;
+    }
+    return std::nullopt;
+}
+
+CollapseResult VirtualMemoryManager::collapse_range(PageNumber base, uint64_t& cycles) {
+    const PageNumber span = page_table_->get_huge_page_pages();
+    const PageTableEntry* leaf = page_table_->get_leaf_entries(base);
+    if (!leaf) {
+        return CollapseResult::Skipped;
+    }
+
+    // Collapse only ranges with at most thp_max_ptes_none unpopulated slots,
+    // a single protection and nothing swapped or compressed out.
+    size_t present = 0;
+    bool in_place = true;
+    bool dirty = false;
+    uint8_t protection = 0;
+    for (PageNumber i = 0; i < span; ++i) {
+        const PageTableEntry& entry = leaf[i];
+        if (!entry.valid) {
+            in_place = false;
+            continue;
+        }
+        if (present > 0 && entry.protection != protection) {
+            return CollapseResult::Skipped;
+        }
+        if (physical_memory_->get_frame(entry.frame_number).pinned) {
+            return CollapseResult::Skipped;
+        }
+        protection = entry.protection;
+        dirty = dirty || entry.dirty;
+        in_place = in_place && entry.frame_number == leaf[0].frame_number + i;
+        present++;
+    }
+    if (present == 0 || span - present > config_.thp_max_ptes_none) {
+        return CollapseResult::Skipped;
+    }
+    auto evicted = evicted_pages_.lower_bound(base);
+    if (evicted != evicted_pages_.end() && evicted->first < base + span) {
+        return CollapseResult::Skipped;
+    }
+    in_place = in_place && leaf[0].frame_number % span == 0;
+
+    if (in_place) {
+        page_table_->collapse(base, leaf[0].frame_number, protection, dirty);
+        thp_promotions_in_place_.inc();
+    } else {
+        // Keep the high watermark intact so promotion never causes reclaim.
+        std::optional<FrameNumber> run;
+        if (physical_memory_->get_free_frames() >= span + config_.high_free_frames) {
+            run = physical_memory_->allocate_contiguous(span, base);
+        }
+        if (!run.has_value()) {
+            thp_collapse_failures_.inc();
+            return CollapseResult::Refused;
+        }
 
+        size_t copied = 0;
+        for (PageNumber i = 0; i < span; ++i) {
+            if (!leaf[i].valid) {
+                physical_memory_->zero_frame(run.value() + i);
+                continue;
+            }
+            std::memcpy(physical_memory_->get_frame_data(run.value() + i),
+                        physical_memory_->get_frame_data(leaf[i].frame_number), config_.page_size);
+            deferred_frees_.push_back(leaf[i].frame_number);
+            copied++;
+        }
+        cycles += copied * scaled_cycles(config_.copy_cycles_per_kb, config_.page_size);
+        thp_pages_copied_.inc(copied);
+        page_table_->collapse(base, run.value(), protection, dirty);
+    }
+
+    tlb_->invalidate_range(base, base + span);
+    queue_invalidation(base, base + span);
+    thp_promotions_.inc();
+    return CollapseResult::Promoted;
+}
+
+void VirtualMemoryManager::split_huge_page(PageNumber vpn) {
+    PageNumber span = page_table_->get_huge_page_pages();
+    PageNumber base = vpn / span * span;
+    page_table_->split_range(base, base + span);
+    tlb_->invalidate(vpn);
+    queue_invalidation(base, base + span);
+}
+
+uint64_t VirtualMemoryManager::evict_page(FrameNumber pfn, bool background) {
+    PageNumber vpn = physical_memory_->get_frame(pfn).owner_vpn;
+    PageTableEntry* entry = page_table_->get_entry(vpn);
+    bool mapped = entry && entry->valid && entry->frame_number == pfn;
+
+    uint64_t cycles = 0;
+    if (mapped) {
+        const uint8_t* data = physical_memory_->get_frame_data(pfn);
+        EvictedPage page;
+
+        bool same_filled = std::all_of(data, data + config_.page_size,
+                                       [&](uint8_t b) { return b == data[0]; });
+        if (same_filled) {
+            page.location = EvictedLocation::SameFilled;
+            page.fill = data[0];
+            same_filled_evictions_.inc();
+        } else {
+            cycles += scaled_cycles(config_.compress_cycles_per_kb, config_.page_size);
+            size_t writebacks = compressed_pool_->get_writebacks();
+            auto handle = compressed_pool_->store(data);
+            cycles += (compressed_pool_->get_writebacks() - writebacks) *
+                      (scaled_cycles(config_.decompress_cycles_per_kb, config_.page_size) +
+                       config_.swap_io_cycles);
+            if (handle.has_value()) {
+                page.location = EvictedLocation::Compressed;
+                page.handle = handle.value();
+                page.lru = compressed_lru_.insert(compressed_lru_.end(), vpn);
+            } else {
+                page.location = EvictedLocation::Swap;
+                page.data.assign(data, data + config_.page_size);
+                cycles += config_.swap_io_cycles;
+                swap_outs_.inc();
+            }
+        }
+
+        evicted_pages_[vpn] = std::move(page);
+        page_table_->invalidate(vpn);
+        tlb_->invalidate(vpn);
+        queue_invalidation(vpn, vpn + 1);
+    }
+
+    (background ? reclaimed_frees_ : deferred_frees_).push_back(pfn);
+    evictions_.inc();
+    return cycles;
+}
+
+uint64_t VirtualMemoryManager::restore_page(PageNumber vpn, FrameNumber pfn) {
+    auto it = evicted_pages_.find(vpn);
+    uint8_t* data = physical_memory_->get_frame_data(pfn);
+    uint64_t cycles = 0;
+
+    switch (it->second.location) {
+    case EvictedLocation::SameFilled:
+        std::memset(data, it->second.fill, config_.page_size);
+        break;
+    case EvictedLocation::Compressed:
+        compressed_pool_->load(it->second.handle, data);
+        compressed_pool_->release(it->second.handle);
+        compressed_lru_.erase(it->second.lru);
+        cycles += scaled_cycles(config_.decompress_cycles_per_kb, config_.page_size);
+        compressed_faults_.inc();
+        break;
+    case EvictedLocation::Swap:
+        std::memcpy(data, it->second.data.data(), config_.page_size);
+        cycles += config_.swap_io_cycles;
+        swap_ins_.inc();
+        break;
+    }
+
+    evicted_pages_.erase(it);
+    return cycles;
+}
+
+// Pool writeback hook: moves the least recently compressed page out to swap.
+bool VirtualMemoryManager::writeback_compressed() {
+    if (compressed_lru_.empty()) {
+        return false;
+    }
+
+    EvictedPage& page = evicted_pages_.at(compressed_lru_.front());
+    compressed_lru_.pop_front();
+    page.data.resize(config_.page_size);
+    compressed_pool_->load(page.handle, page.data.data());
+    compressed_pool_->release(page.handle);
+    page.location = EvictedLocation::Swap;
+    swap_outs_.inc();
     return true;
 }
 
+void VirtualMemoryManager::discard_evicted(PageNumber start, PageNumber end) {
+    auto it = evicted_pages_.lower_bound(start);
+    while (it != evicted_pages_.end() && it->first < end) {
+        if (it->second.location == EvictedLocation::Compressed) {
+            compressed_pool_->release(it->second.handle);
+            compressed_lru_.erase(it->second.lru);
+        }
+        it = evicted_pages_.erase(it);
+    }
+}
+
+uint64_t VirtualMemoryManager::scaled_cycles(size_t cycles_per_kb, size_t bytes) const {
+    return static_cast<uint64_t>(cycles_per_kb) * bytes / 1024;
+}
+
 } // namespace vm
@@ -0,0 +1,575 @@
+#include "Workload.h"
+#include "VirtualMemoryManager.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace vm {
+
+namespace {
+
+uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+uint64_t mask_covering(uint64_t n) {
+    uint64_t mask = 0;
+    while (mask < n - 1) {
+        mask = (mask << 1) | 1;
+    }
+    return mask;
+}
+
+WorkloadRegion bounding_region(const std::vector<WorkloadRegion>& regions) {
+    if (regions.empty()) {
+        return WorkloadRegion{0, 0};
+    }
+    VirtualAddress lo = regions.front().base;
+    VirtualAddress hi = regions.front().base + regions.front().length;
+    for (const auto& region : regions) {
+        lo = std::min(lo, region.base);
+        hi = std::max(hi, region.base + region.length);
+    }
+    return WorkloadRegion{lo, hi - lo};
+}
+
+} // namespace
+
+RandomLanes::RandomLanes(uint64_t seed) : buffered_(0) {
+    this->seed(seed);
+}
+
+void RandomLanes::seed(uint64_t seed) {
+    uint64_t state = seed;
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        for (size_t word = 0; word < 4; ++word) {
+            state_[word][lane] = splitmix64(state);
+        }
+    }
+    buffered_ = 0;
+}
+
+void RandomLanes::step(uint64_t* out) {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        uint64_t s0 = state_[0][lane];
+        uint64_t s1 = state_[1][lane];
+        uint64_t s2 = state_[2][lane];
+        uint64_t s3 = state_[3][lane];
+
+        out[lane] = rotl(s0 + s3, 23) + s0;
+
+        uint64_t t = s1 << 17;
+        s2 ^= s0;
+        s3 ^= s1;
+        s1 ^= s2;
+        s0 ^= s3;
+        s2 ^= t;
+        s3 = rotl(s3, 45);
+
+        state_[0][lane] = s0;
+        state_[1][lane] = s1;
+        state_[2][lane] = s2;
+        state_[3][lane] = s3;
+    }
+}
+
+uint64_t RandomLanes::next() {
+    if (buffered_ == 0) {
+        step(buffer_);
+        buffered_ = kLanes;
+    }
+    return buffer_[kLanes - buffered_--];
+}
+
+void RandomLanes::fill(uint64_t* out, size_t count) {
+    size_t i = 0;
+    while (i < count && buffered_ > 0) {
+        out[i++] = next();
+    }
+    for (; i + kLanes <= count; i += kLanes) {
+        step(out + i);
+    }
+    while (i < count) {
+        out[i++] = next();
+    }
+}
+
+WorkloadGenerator::WorkloadGenerator(WorkloadRegion region, double write_ratio, uint64_t seed)
+    : region_(region),
+      write_threshold_(static_cast<uint32_t>(std::min(std::max(write_ratio, 0.0), 1.0) * 65536.0)),
+      seed_(seed),
+      rng_(seed) {}
+
+void WorkloadGenerator::reset() {
+    rng_.seed(seed_);
+}
+
+void WorkloadGenerator::footprint(std::vector<WorkloadRegion>& regions) const {
+    regions.push_back(region_);
+}
+
+StridedWorkload::StridedWorkload(WorkloadRegion region, size_t stride, double write_ratio, uint64_t seed)
+    : WorkloadGenerator(region, write_ratio, seed), stride_(stride), position_(0) {
+    if (region.length == 0 || stride == 0) {
+        throw std::invalid_argument("Strided workload needs a non-empty region and stride");
+    }
+}
+
+size_t StridedWorkload::generate(MemoryAccess* out, size_t count) {
+    uint64_t rnd[kChunkSize];
+    for (size_t done = 0; done < count;) {
+        size_t n = std::min(kChunkSize, count - done);
+        rng_.fill(rnd, n);
+        for (size_t i = 0; i < n; ++i) {
+            out[done + i].address = region_.base + position_;
+            out[done + i].write = is_write(rnd[i]);
+            position_ += stride_;
+            if (position_ >= region_.length) {
+                position_ %= region_.length;
+            }
+        }
+        done += n;
+    }
+    return count;
+}
+
+void StridedWorkload::reset() {
+    WorkloadGenerator::reset();
+    position_ = 0;
+}
+
+UniformWorkload::UniformWorkload(WorkloadRegion region, double write_ratio, uint64_t seed)
+    : WorkloadGenerator(region, write_ratio, seed) {
+    if (region.length == 0) {
+        throw std::invalid_argument("Uniform workload needs a non-empty region");
+    }
+}
+
+size_t UniformWorkload::generate(MemoryAccess* out, size_t count) {
+    uint64_t rnd[kChunkSize];
+    for (size_t done = 0; done < count;) {
+        size_t n = std::min(kChunkSize, count - done);
+        rng_.fill(rnd, n);
+        for (size_t i = 0; i < n; ++i) {
+            out[done + i].address = region_.base + bounded_random(rnd[i], region_.length);
+            out[done + i].write = is_write(rnd[i]);
+        }
+        done += n;
+    }
+    return count;
+}
+
+ZipfianWorkload::ZipfianWorkload(WorkloadRegion region, size_t page_size, double theta,
+                                 double write_ratio, uint64_t seed, bool scramble)
+    : WorkloadGenerator(region, write_ratio, seed),
+      page_size_(page_size),
+      num_pages_(page_size > 0 ? region.length / page_size : 0),
+      theta_(theta),
+      scramble_(scramble) {
+
+    if (num_pages_ == 0 || theta <= 0.0) {
+        throw std::invalid_argument("Zipfian workload needs at least one page and theta > 0");
+    }
+
+    permute_mask_ = mask_covering(num_pages_);
+    h_integral_x1_ = h_integral(1.5) - 1.0;
+    h_integral_n_ = h_integral(static_cast<double>(num_pages_) + 0.5);
+    s_ = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+    if (num_pages_ <= kMaxAliasPages) {
+        build_alias_table();
+    }
+}
+
+// Vose's alias method over the page weights rank^-theta, so a sample costs
+// one table lookup instead of an exp/log rejection loop.
+void ZipfianWorkload::build_alias_table() {
+    std::vector<double> scaled(num_pages_);
+    double total = 0.0;
+    for (uint64_t rank = 1; rank <= num_pages_; ++rank) {
+        uint64_t page = scramble_ ? permute(rank - 1) : rank - 1;
+        scaled[page] = h(static_cast<double>(rank));
+        total += scaled[page];
+    }
+
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+    for (uint64_t page = 0; page < num_pages_; ++page) {
+        scaled[page] *= static_cast<double>(num_pages_) / total;
+        (scaled[page] < 1.0 ? small : large).push_back(static_cast<uint32_t>(page));
+    }
+
+    alias_threshold_.assign(num_pages_, UINT32_MAX);
+    alias_page_.resize(num_pages_);
+    for (uint64_t page = 0; page < num_pages_; ++page) {
+        alias_page_[page] = static_cast<uint32_t>(page);
+    }
+    while (!small.empty() && !large.empty()) {
+        uint32_t lo = small.back();
+        uint32_t hi = large.back();
+        small.pop_back();
+        alias_threshold_[lo] = static_cast<uint32_t>(std::min(scaled[lo] * 4294967296.0, 4294967295.0));
+        alias_page_[lo] = hi;
+        scaled[hi] -= 1.0 - scaled[lo];
+        if (scaled[hi] < 1.0) {
+            large.pop_back();
+            small.push_back(hi);
+        }
+    }
+}
+
+size_t ZipfianWorkload::generate(MemoryAccess* out, size_t count) {
+    if (!alias_threshold_.empty()) {
+        uint64_t rnd[2 * kChunkSize];
+        for (size_t done = 0; done < count;) {
+            size_t n = std::min(kChunkSize, count - done);
+            rng_.fill(rnd, 2 * n);
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t pick = rnd[2 * i];
+                uint64_t r = rnd[2 * i + 1];
+                uint64_t page = bounded_random(pick, num_pages_);
+                if (static_cast<uint32_t>(pick) >= alias_threshold_[page]) {
+                    page = alias_page_[page];
+                }
+                out[done + i].address = region_.base + page * page_size_ + bounded_random(r, page_size_);
+                out[done + i].write = is_write(r);
+            }
+            done += n;
+        }
+        return count;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t rank = sample_rank();
+        uint64_t page = scramble_ ? permute(rank - 1) : rank - 1;
+        uint64_t r = rng_.next();
+        out[i].address = region_.base + page * page_size_ + bounded_random(r, page_size_);
+        out[i].write = is_write(r);
+    }
+    return count;
+}
+
+uint64_t ZipfianWorkload::sample_rank() {
+    while (true) {
+        double u = h_integral_n_ + rng_.next_double() * (h_integral_x1_ - h_integral_n_);
+        double x = h_integral_inverse(u);
+        double k = std::floor(x + 0.5);
+        if (k < 1.0) {
+            k = 1.0;
+        } else if (k > static_cast<double>(num_pages_)) {
+            k = static_cast<double>(num_pages_);
+        }
+        if (k - x <= s_ || u >= h_integral(k + 0.5) - h(k)) {
+            return static_cast<uint64_t>(k);
+        }
+    }
+}
+
+uint64_t ZipfianWorkload::permute(uint64_t index) const {
+    uint64_t x = index;
+    do {
+        x = (x * 0x5851F42D4C957F2DULL + 0x14057B7EF767814FULL) & permute_mask_;
+    } while (x >= num_pages_);
+    return x;
+}
+
+double ZipfianWorkload::h(double x) const {
+    return std::exp(-theta_ * std::log(x));
+}
+
+double ZipfianWorkload::h_integral(double x) const {
+    double log_x = std::log(x);
+    double t = (1.0 - theta_) * log_x;
+    double helper = std::abs(t) > 1e-8 ? std::expm1(t) / t : 1.0 + t * 0.5 * (1.0 + t / 3.0 * (1.0 + 0.25 * t));
+    return helper * log_x;
+}
+
+double ZipfianWorkload::h_integral_inverse(double x) const {
+    double t = x * (1.0 - theta_);
+    if (t < -1.0) {
+        t = -1.0;
+    }
+    double helper = std::abs(t) > 1e-8 ? std::log1p(t) / t : 1.0 - t * (0.5 - t * (1.0 / 3.0 - 0.25 * t));
+    return std::exp(helper * x);
+}
+
+HotColdWorkload::HotColdWorkload(WorkloadRegion region, size_t page_size, double hot_fraction,
+                                 double hot_probability, double write_ratio, uint64_t seed)
+    : WorkloadGenerator(region, write_ratio, seed), page_size_(page_size) {
+
+    if (page_size == 0 || region.length < page_size) {
+        throw std::invalid_argument("Hot/cold workload needs at least one page");
+    }
+
+    uint64_t pages = region.length / page_size;
+    uint64_t hot_pages = static_cast<uint64_t>(std::llround(hot_fraction * static_cast<double>(pages)));
+    hot_pages = std::min(std::max<uint64_t>(hot_pages, 1), pages);
+
+    hot_bytes_ = hot_pages * page_size;
+    cold_bytes_ = region.length - hot_bytes_;
+    hot_threshold_ = static_cast<uint64_t>(std::min(std::max(hot_probability, 0.0), 1.0) * 4294967296.0);
+}
+
+size_t HotColdWorkload::generate(MemoryAccess* out, size_t count) {
+    uint64_t rnd[2 * kChunkSize];
+    for (size_t done = 0; done < count;) {
+        size_t n = std::min(kChunkSize, count - done);
+        rng_.fill(rnd, 2 * n);
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t choice = rnd[2 * i];
+            uint64_t r = rnd[2 * i + 1];
+            bool hot = cold_bytes_ == 0 || (choice >> 32) < hot_threshold_;
+            out[done + i].address = hot ? region_.base + bounded_random(r, hot_bytes_)
+                                        : region_.base + hot_bytes_ + bounded_random(r, cold_bytes_);
+            out[done + i].write = is_write(choice);
+        }
+        done += n;
+    }
+    return count;
+}
+
+PointerChaseWorkload::PointerChaseWorkload(WorkloadRegion region, size_t node_size,
+                                           double write_ratio, uint64_t seed)
+    : WorkloadGenerator(region, write_ratio, seed),
+      node_size_(node_size),
+      num_nodes_(node_size > 0 ? region.length / node_size : 0) {
+
+    if (num_nodes_ == 0) {
+        throw std::invalid_argument("Pointer-chase workload needs at least one node");
+    }
+
+    mask_ = mask_covering(num_nodes_);
+    reset();
+}
+
+size_t PointerChaseWorkload::generate(MemoryAccess* out, size_t count) {
+    uint64_t rnd[kChunkSize];
+    for (size_t done = 0; done < count;) {
+        size_t n = std::min(kChunkSize, count - done);
+        rng_.fill(rnd, n);
+        for (size_t i = 0; i < n; ++i) {
+            do {
+                current_ = (current_ * multiplier_ + increment_) & mask_;
+            } while (current_ >= num_nodes_);
+            out[done + i].address = region_.base + current_ * node_size_;
+            out[done + i].write = is_write(rnd[i]);
+        }
+        done += n;
+    }
+    return count;
+}
+
+void PointerChaseWorkload::reset() {
+    WorkloadGenerator::reset();
+
+    uint64_t state = seed_;
+    multiplier_ = (splitmix64(state) & ~3ULL) | 1;
+    increment_ = splitmix64(state) | 1;
+    current_ = splitmix64(state) & mask_;
+    while (current_ >= num_nodes_) {
+        current_ = (current_ * multiplier_ + increment_) & mask_;
+    }
+}
+
+PhaseWorkload::PhaseWorkload(std::vector<Phase> phases)
+    : WorkloadGenerator(WorkloadRegion{0, 0}, 0.0, 0),
+      phases_(std::move(phases)),
+      current_phase_(0),
+      phase_position_(0) {
+
+    bool has_length = false;
+    for (const auto& phase : phases_) {
+        if (!phase.generator) {
+            throw std::invalid_argument("Phase workload has an empty phase");
+        }
+        has_length = has_length || phase.length > 0;
+    }
+    if (!has_length) {
+        throw std::invalid_argument("Phase workload needs at least one non-empty phase");
+    }
+
+    std::vector<WorkloadRegion> regions;
+    footprint(regions);
+    region_ = bounding_region(regions);
+}
+
+size_t PhaseWorkload::generate(MemoryAccess* out, size_t count) {
+    size_t done = 0;
+    while (done < count) {
+        Phase& phase = phases_[current_phase_];
+        size_t n = std::min(phase.length - phase_position_, count - done);
+        if (n > 0) {
+            phase.generator->generate(out + done, n);
+            done += n;
+            phase_position_ += n;
+        }
+        if (phase_position_ >= phase.length) {
+            current_phase_ = (current_phase_ + 1) % phases_.size();
+            phase_position_ = 0;
+        }
+    }
+    return count;
+}
+
+void PhaseWorkload::reset() {
+    WorkloadGenerator::reset();
+    for (auto& phase : phases_) {
+        phase.generator->reset();
+    }
+    current_phase_ = 0;
+    phase_position_ = 0;
+}
+
+void PhaseWorkload::footprint(std::vector<WorkloadRegion>& regions) const {
+    for (const auto& phase : phases_) {
+        phase.generator->footprint(regions);
+    }
+}
+
+MixWorkload::MixWorkload(std::vector<Component> components, uint64_t seed)
+    : WorkloadGenerator(WorkloadRegion{0, 0}, 0.0, seed),
+      components_(std::move(components)) {
+
+    double total = 0.0;
+    for (const auto& component : components_) {
+        if (!component.generator || component.weight < 0.0) {
+            throw std::invalid_argument("Mix workload has an invalid component");
+        }
+        total += component.weight;
+    }
+    if (total <= 0.0 || components_.size() > 256) {
+        throw std::invalid_argument("Mix workload needs 1-256 components with positive total weight");
+    }
+
+    double cumulative = 0.0;
+    for (const auto& component : components_) {
+        cumulative += component.weight;
+        thresholds_.push_back(static_cast<uint64_t>(cumulative / total * 4294967296.0));
+    }
+    thresholds_.back() = 1ULL << 32;
+
+    buffers_.resize(components_.size());
+    for (auto& buffer : buffers_) {
+        buffer.resize(kChunkSize);
+    }
+
+    std::vector<WorkloadRegion> regions;
+    footprint(regions);
+    region_ = bounding_region(regions);
+}
+
+size_t MixWorkload::generate(MemoryAccess* out, size_t count) {
+    uint64_t rnd[kChunkSize];
+    uint8_t choice[kChunkSize];
+    std::vector<size_t> counts(components_.size());
+    std::vector<size_t> cursors(components_.size());
+
+    for (size_t done = 0; done < count;) {
+        size_t n = std::min(kChunkSize, count - done);
+        rng_.fill(rnd, n);
+
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t r = rnd[i] >> 32;
+            size_t k = 0;
+            while (r >= thresholds_[k]) {
+                k++;
+            }
+            choice[i] = static_cast<uint8_t>(k);
+            counts[k]++;
+        }
+
+        for (size_t k = 0; k < components_.size(); ++k) {
+            if (counts[k] > 0) {
+                components_[k].generator->generate(buffers_[k].data(), counts[k]);
+            }
+            cursors[k] = 0;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            size_t k = choice[i];
+            out[done + i] = buffers_[k][cursors[k]++];
+        }
+        done += n;
+    }
+    return count;
+}
+
+void MixWorkload::reset() {
+    WorkloadGenerator::reset();
+    for (auto& component : components_) {
+        component.generator->reset();
+    }
+}
+
+void MixWorkload::footprint(std::vector<WorkloadRegion>& regions) const {
+    for (const auto& component : components_) {
+        component.generator->footprint(regions);
+    }
+}
+
+void map_workload_footprint(VirtualMemoryManager& vmm, const WorkloadGenerator& generator) {
+    const size_t page_size = vmm.get_config().page_size;
+
+    std::vector<WorkloadRegion> regions;
+    generator.footprint(regions);
+
+    for (const auto& region : regions) {
+        if (region.length == 0) {
+            continue;
+        }
+        VirtualAddress start = region.base / page_size * page_size;
+        VirtualAddress end = (region.base + region.length + page_size - 1) / page_size * page_size;
+
+        VirtualAddress cursor = start;
+        for (const auto& vma : vmm.get_vmas().get_areas()) {
+            if (vma.end <= cursor) {
+                continue;
+            }
+            if (vma.start >= end) {
+                break;
+            }
+            if (vma.start > cursor) {
+                vmm.mmap(cursor, vma.start - cursor, kProtRead | kProtWrite, VmaBacking::Anonymous, true);
+            }
+            cursor = std::max(cursor, vma.end);
+        }
+        if (cursor < end) {
+            vmm.mmap(cursor, end - cursor, kProtRead | kProtWrite, VmaBacking::Anonymous, true);
+        }
+    }
+}
+
+WorkloadRunStats run_workload(VirtualMemoryManager& vmm, WorkloadGenerator& generator,
+                              size_t count, bool map_footprint) {
+    if (map_footprint) {
+        map_workload_footprint(vmm, generator);
+    }
+
+    WorkloadRunStats stats;
+    std::vector<MemoryAccess> batch(4096);
+
+    while (stats.accesses < count) {
+        size_t n = generator.generate(batch.data(), std::min(batch.size(), count - stats.accesses));
+        for (size_t i = 0; i < n; ++i) {
+            if (batch[i].write) {
+                stats.writes++;
+            } else {
+                stats.reads++;
+            }
+            if (!vmm.translate(batch[i].address, batch[i].write).has_value()) {
+                stats.failed++;
+            }
+        }
+        stats.accesses += n;
+    }
+    return stats;
+}
+
+} // namespace vm
@@ -1,7 +1,18 @@
+#include "NestedMmu.h"
+#include "PageRunTrace.h"
+#include "SampledSimulation.h"
+#include "SharedAddressSpace.h"
 #include "VirtualMemoryManager.h"
+#include "Workload.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <random>
 #include <iomanip>
+#include <thread>
 
 using namespace vm;
 
@@ -56,8 +67,6 @@ void demo_demand_paging(VirtualMemoryManager& vmm) {
     std::cout << "\n=== Demo 3: Demand Paging ===\n";
 
     const size_t page_size = vmm.get_config().page_size;
-    size_t initial_page_faults = vmm.get_physical_memory().get_page_faults();
-
     vmm.reset_statistics();
 
     std::cout << "Accessing new pages (will cause page faults)...\n";
@@ -66,7 +75,7 @@ void demo_demand_paging(VirtualMemoryManager& vmm) {
         vmm.write_byte(addr, static_cast<uint8_t>(i * 7));
     }
 
-    size_t page_faults = vmm.get_physical_memory().get_page_faults();
+    size_t page_faults = vmm.get_page_faults();
     std::cout << "Page faults during allocation: " << page_faults << "\n";
 
     std::cout << "\nAccessing the same pages again (no new page faults)...\n";
@@ -79,7 +88,7 @@ void demo_demand_paging(VirtualMemoryManager& vmm) {
         }
     }
 
-    size_t new_page_faults = vmm.get_physical_memory().get_page_faults();
+    size_t new_page_faults = vmm.get_page_faults();
     std::cout << "Page faults during re-access: " << new_page_faults << "\n";
 }
 
@@ -109,22 +118,18 @@ void demo_random_access(VirtualMemoryManager& vmm) {
     const size_t page_size = vmm.get_config().page_size;
     const size_t num_accesses = 1000;
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<VirtualAddress> addr_dist(0, page_size * 100);
-    std::uniform_int_distribution<uint8_t> value_dist(0, 255);
+    UniformWorkload workload(WorkloadRegion{0, page_size * 100}, 0.5, 42);
+    std::vector<MemoryAccess> accesses(num_accesses);
+    workload.generate(accesses.data(), accesses.size());
 
     vmm.reset_statistics();
 
     std::cout << "Performing " << num_accesses << " random memory accesses...\n";
-    for (size_t i = 0; i < num_accesses; ++i) {
-        VirtualAddress addr = addr_dist(gen);
-        uint8_t value = value_dist(gen);
-
-        if (i % 2 == 0) {
-            vmm.write_byte(addr, value);
+    for (const auto& access : accesses) {
+        if (access.write) {
+            vmm.write_byte(access.address, static_cast<uint8_t>(access.address));
         } else {
-            vmm.read_byte(addr);
+            vmm.read_byte(access.address);
         }
     }
 
@@ -155,7 +160,6 @@ void demo_access_patterns(VirtualMemoryManager& vmm) {
     vmm.get_tlb().clear();
     vmm.reset_statistics();
 
-    std::random_device rd;
     std::mt19937 gen(42);
     std::vector<size_t> indices;
     for (size_t i = 0; i < num_pages; ++i) {
@@ -175,6 +179,714 @@ void demo_access_patterns(VirtualMemoryManager& vmm) {
     std::cout << "  TLB hit rate: " << vmm.get_tlb().get_hit_rate() * 100.0 << "%\n";
 }
 
+void demo_workload_generators() {
+    std::cout << "\n=== Demo 7: Synthetic Workload Generators ===\n";
+
+    Config config = Config::default_config();
+    const size_t page_size = config.page_size;
+    const WorkloadRegion region{1ULL << 30, 8192 * page_size};
+    const size_t num_accesses = 200000;
+
+    auto report = [&](const char* name, WorkloadGenerator& workload) {
+        VirtualMemoryManager vmm(config);
+        WorkloadRunStats stats = run_workload(vmm, workload, num_accesses);
+        std::cout << "  " << std::left << std::setw(14) << name << std::right
+                  << " TLB hit rate: " << std::setw(6) << vmm.get_tlb().get_hit_rate() * 100.0
+                  << "%  page faults: " << vmm.get_page_faults()
+                  << "  writes: " << stats.writes << "\n";
+    };
+
+    SequentialWorkload sequential(region, 64, 0.3, 1);
+    StridedWorkload strided(region, page_size + 64, 0.3, 2);
+    UniformWorkload uniform(region, 0.3, 3);
+    ZipfianWorkload zipfian(region, page_size, 0.99, 0.3, 4);
+    HotColdWorkload hot_cold(region, page_size, 0.01, 0.95, 0.3, 5);
+    PointerChaseWorkload chase(region, 64, 0.0, 6);
+
+    std::vector<PhaseWorkload::Phase> phases;
+    phases.push_back({std::make_unique<SequentialWorkload>(region, 64, 0.3, 7), 50000});
+    phases.push_back({std::make_unique<ZipfianWorkload>(region, page_size, 1.2, 0.3, 8), 50000});
+    PhaseWorkload phased(std::move(phases));
+
+    std::vector<MixWorkload::Component> components;
+    components.push_back({std::make_unique<HotColdWorkload>(region, page_size, 0.01, 0.95, 0.3, 9), 0.8});
+    components.push_back({std::make_unique<UniformWorkload>(region, 0.3, 10), 0.2});
+    MixWorkload mix(std::move(components), 11);
+
+    std::cout << std::fixed << std::setprecision(2);
+    report("sequential", sequential);
+    report("strided", strided);
+    report("uniform", uniform);
+    report("zipfian", zipfian);
+    report("hot/cold", hot_cold);
+    report("pointer-chase", chase);
+    report("phased", phased);
+    report("mix", mix);
+
+    const size_t batch_size = 4096;
+    const size_t rounds = 4096;
+    std::vector<MemoryAccess> batch(batch_size);
+    auto throughput = [&](const char* name, WorkloadGenerator& generator) {
+        generator.reset();
+        uint64_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; ++r) {
+            generator.generate(batch.data(), batch.size());
+            checksum += batch[r % batch_size].address;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double rate = static_cast<double>(batch_size * rounds) / elapsed.count() / 1e6;
+        std::cout << name << " generation throughput: " << rate << " M addresses/sec"
+                  << " (checksum " << (checksum & 0xFFFF) << ")\n";
+    };
+    std::cout << "\n";
+    throughput("Uniform", uniform);
+    throughput("Zipfian", zipfian);
+}
+
+void demo_address_space_regions(VirtualMemoryManager& vmm) {
+    std::cout << "\n=== Demo 8: Address Space Regions ===\n";
+
+    const size_t page_size = vmm.get_config().page_size;
+    const size_t region_pages = 256;
+
+    auto region = vmm.mmap(0, region_pages * page_size, kProtRead | kProtWrite);
+    if (!region.has_value()) {
+        std::cout << "  mmap failed\n";
+        return;
+    }
+    std::cout << "Mapped " << region_pages << " pages at virtual address " << region.value() << "\n";
+
+    for (size_t i = 0; i < region_pages; ++i) {
+        vmm.write_byte(region.value() + i * page_size, static_cast<uint8_t>(i));
+    }
+    std::cout << "  Resident page table entries: " << vmm.get_page_table().get_num_entries() << "\n";
+
+    vmm.mprotect(region.value(), region_pages * page_size, kProtRead);
+    bool write_allowed = vmm.translate(region.value(), true).has_value();
+    std::cout << "  Write after mprotect(PROT_READ): "
+              << (write_allowed ? "allowed" : "protection fault") << "\n";
+
+    vmm.munmap(region.value(), region_pages * page_size);
+    std::cout << "  Resident page table entries after munmap: "
+              << vmm.get_page_table().get_num_entries() << "\n";
+
+    bool read_allowed = vmm.translate(region.value(), false).has_value();
+    std::cout << "  Read after munmap: " << (read_allowed ? "allowed" : "segmentation fault") << "\n";
+}
+
+void demo_tlb_shootdowns() {
+    std::cout << "\n=== Demo 9: TLB Shootdowns ===\n";
+
+    Config config = Config::default_config();
+    config.num_cpus = 4;
+    VirtualMemoryManager vmm(config);
+
+    const size_t page_size = config.page_size;
+    const size_t region_pages = 512;
+
+    auto touch_from_all_cpus = [&](VirtualAddress base) {
+        for (size_t cpu = 0; cpu < config.num_cpus; ++cpu) {
+            vmm.set_cpu(cpu);
+            for (size_t i = 0; i < region_pages; i += 8) {
+                vmm.write_byte(base + i * page_size, static_cast<uint8_t>(i));
+            }
+        }
+        vmm.set_cpu(0);
+    };
+
+    auto region = vmm.mmap(0, region_pages * page_size, kProtRead | kProtWrite);
+    touch_from_all_cpus(region.value());
+    size_t ipis_before = vmm.get_shootdown_batch().get_ipis();
+    for (size_t i = 0; i < region_pages; ++i) {
+        vmm.free_page(region.value() + i * page_size);
+    }
+    vmm.flush_tlb_shootdowns();
+    std::cout << "Page-by-page free of " << region_pages << " pages: "
+              << vmm.get_shootdown_batch().get_ipis() - ipis_before << " IPIs\n";
+
+    touch_from_all_cpus(region.value());
+    ipis_before = vmm.get_shootdown_batch().get_ipis();
+    vmm.munmap(region.value(), region_pages * page_size);
+    std::cout << "Single munmap of " << region_pages << " pages: "
+              << vmm.get_shootdown_batch().get_ipis() - ipis_before << " IPIs\n";
+    std::cout << "Total modelled shootdown cost: "
+              << vmm.get_shootdown_batch().get_cycles() << " cycles\n";
+    std::cout << "Entries invalidated per CPU:";
+    for (size_t cpu = 0; cpu < vmm.get_num_cpus(); ++cpu) {
+        std::cout << " cpu" << cpu << "=" << vmm.get_tlb(cpu).get_invalidations();
+    }
+    std::cout << "\n";
+
+    std::cout << "\nASID-tagged TLB across a context switch:\n";
+    TLB tlb(config.tlb_size, vmm.get_metrics_registry(), "context_switch_tlb");
+    tlb.set_asid(1);
+    tlb.insert(10, 100);
+    tlb.set_asid(2);
+    tlb.insert(10, 200);
+    tlb.set_asid(1);
+    auto frame = tlb.lookup(10);
+    std::cout << "  ASID 1 entry survives switch to ASID 2: "
+              << (frame.has_value() && frame.value() == 100 ? "yes" : "no") << "\n";
+}
+
+void demo_compressed_tier() {
+    std::cout << "\n=== Demo 10: Compressed Memory Tier ===\n";
+
+    Config config = Config::default_config();
+    config.physical_memory_size = 4 * 1024 * 1024;
+    config.num_frames = config.physical_memory_size / config.page_size;
+    config.compressed_pool_size = config.physical_memory_size / 5;
+    VirtualMemoryManager vmm(config);
+
+    const size_t page_size = config.page_size;
+    const size_t num_pages = 2 * config.num_frames;
+    const WorkloadRegion region{0, num_pages * page_size};
+    map_workload_footprint(vmm, UniformWorkload(region));
+
+    // Every page starts with a run of pseudo-random letters that compresses
+    // poorly, followed by repetitive text (every fourth page) or zeroes.
+    auto expected_byte = [&](size_t page, size_t i) -> uint8_t {
+        if (i < page_size / 4) {
+            uint64_t h = (page * page_size + i) * 0x9E3779B97F4A7C15ULL;
+            h = (h ^ (h >> 29)) * 0xBF58476D1CE4E5B9ULL;
+            return static_cast<uint8_t>('a' + (h >> 32) % 26);
+        }
+        size_t text_bytes = (page % 4 == 0) ? page_size : page_size / 2;
+        return i < text_bytes ? static_cast<uint8_t>('a' + (i * 7 + page) % 26) : 0;
+    };
+
+    std::cout << "Filling " << num_pages << " pages into " << config.num_frames << " frames...\n";
+    for (size_t page = 0; page < num_pages; ++page) {
+        VirtualAddress base = page * page_size;
+        for (size_t i = 0; i < page_size; ++i) {
+            uint8_t value = expected_byte(page, i);
+            if (value != 0) {
+                vmm.write_byte(base + i, value);
+            }
+        }
+    }
+
+    std::cout << "Re-reading with a hot/cold pattern...\n";
+    HotColdWorkload hot_cold(region, page_size, 0.2, 0.9, 0.0, 12);
+    std::vector<MemoryAccess> accesses(20000);
+    hot_cold.generate(accesses.data(), accesses.size());
+    size_t mismatches = 0;
+    for (const auto& access : accesses) {
+        uint8_t expected = expected_byte(access.address / page_size, access.address % page_size);
+        if (vmm.read_byte(access.address) != expected) {
+            mismatches++;
+        }
+    }
+
+    CompressedPool& pool = vmm.get_compressed_pool();
+    std::cout << "  Evictions: " << vmm.get_evictions() << "\n";
+    std::cout << "  Pool: " << pool.get_stored_pages() << " pages in " << pool.get_used_pages()
+              << " of " << config.num_frames << " RAM frames (ratio " << std::fixed << std::setprecision(2)
+              << pool.get_compression_ratio() << ", occupancy "
+              << pool.get_occupancy() * 100.0 << "%)\n";
+    std::cout << "  Written back to swap when full: " << pool.get_writebacks() << " pages\n";
+    std::cout << "  Data mismatches after decompression: " << mismatches << "\n";
+    std::cout << "  Modelled cycles: " << vmm.get_modelled_cycles() << "\n";
+}
+
+void demo_background_reclaim() {
+    std::cout << "\n=== Demo 11: Background Reclaim ===\n";
+
+    for (bool background : {false, true}) {
+        Config config = Config::default_config();
+        config.physical_memory_size = 4 * 1024 * 1024;
+        config.num_frames = config.physical_memory_size / config.page_size;
+        config.min_free_frames = 16;
+        config.low_free_frames = 64;
+        config.high_free_frames = 128;
+        config.background_reclaim = background;
+        VirtualMemoryManager vmm(config);
+
+        const WorkloadRegion region{0, 3 * config.num_frames * config.page_size};
+        HotColdWorkload workload(region, config.page_size, 0.25, 0.8, 0.3, 21);
+        map_workload_footprint(vmm, workload);
+
+        std::vector<MemoryAccess> accesses(4096);
+        for (size_t round = 0; round < 50; ++round) {
+            workload.generate(accesses.data(), accesses.size());
+            for (const auto& access : accesses) {
+                if (access.write) {
+                    vmm.write_byte(access.address, static_cast<uint8_t>(access.address));
+                } else {
+                    vmm.read_byte(access.address);
+                }
+            }
+            std::this_thread::yield();
+        }
+
+        Histogram fault_cycles = vmm.get_metrics().histogram("fault_cycles", "");
+        std::cout << (background ? "Background reclaim daemon:\n" : "Direct reclaim only:\n");
+        std::cout << "  Page faults: " << vmm.get_page_faults() << "\n";
+        std::cout << "  Served from pre-reclaimed frames: " << vmm.get_prereclaimed_faults() << "\n";
+        std::cout << "  Stalled in direct reclaim: " << vmm.get_direct_reclaim_faults() << "\n";
+        std::cout << "  Pages reclaimed (background / direct): "
+                  << vmm.get_background_reclaimed_pages() << " / "
+                  << vmm.get_direct_reclaimed_pages() << "\n";
+        std::cout << "  Fault cost p50 / p99: " << fault_cycles.percentile(0.50) << " / "
+                  << fault_cycles.percentile(0.99) << " cycles\n";
+    }
+}
+
+void demo_nested_paging() {
+    std::cout << "\n=== Demo 12: Nested Paging ===\n";
+
+    struct Setup {
+        const char* name;
+        bool walk_caches;
+        bool huge_pages;
+    };
+    const Setup setups[] = {
+        {"4K pages, no walk caches", false, false},
+        {"4K pages, walk caches", true, false},
+        {"2M pages, no walk caches", false, true},
+        {"2M pages, walk caches", true, true},
+    };
+
+    const WorkloadRegion region{1ULL << 32, 256 * 1024 * 1024};
+    std::vector<MemoryAccess> accesses(200000);
+    ZipfianWorkload(region, 4096, 0.8, 0.0, 5).generate(accesses.data(), accesses.size());
+
+    std::cout << "Native 4-level walk: 4 memory references\n";
+    for (const auto& setup : setups) {
+        NestedPagingConfig config = NestedPagingConfig::x86_64_config();
+        config.guest_huge_pages = setup.huge_pages;
+        config.host_huge_pages = setup.huge_pages;
+        if (setup.walk_caches) {
+            config.nested_tlb_size = 32;
+            config.guest_pwc_size = 32;
+            config.host_pwc_size = 32;
+        }
+        NestedMmu mmu(config);
+
+        for (const auto& access : accesses) {
+            mmu.translate(access.address);
+        }
+
+        std::cout << "  " << std::left << std::setw(26) << setup.name << std::right
+                  << " walks: " << std::setw(6) << mmu.get_walks()
+                  << "  refs/walk: " << std::fixed << std::setprecision(2) << mmu.get_mean_walk_refs()
+                  << " (max " << mmu.get_max_walk_refs() << ")"
+                  << "  cycles/access: "
+                  << static_cast<double>(mmu.get_modelled_cycles()) / accesses.size() << "\n";
+    }
+}
+
+void demo_shared_address_space() {
+    std::cout << "\n=== Demo 13: Shared Address Space ===\n";
+
+    const WorkloadRegion region{0, 64 * 1024 * 1024};
+    const size_t accesses_per_thread = 500000;
+
+    for (size_t num_threads : {1, 2, 4, 8}) {
+        SharedAddressSpace space(Config::default_config());
+        space.mmap(region.base, region.length, kProtRead | kProtWrite);
+
+        std::vector<std::unique_ptr<WorkloadGenerator>> warmup;
+        for (size_t t = 0; t < num_threads; ++t) {
+            warmup.push_back(std::make_unique<SequentialWorkload>(region, 4096));
+        }
+        space.replay(warmup, region.length / 4096);
+
+        std::vector<std::unique_ptr<WorkloadGenerator>> workloads;
+        for (size_t t = 0; t < num_threads; ++t) {
+            workloads.push_back(std::make_unique<ZipfianWorkload>(region, 4096, 0.99, 0.05, 100 + t));
+        }
+        ParallelReplayStats stats = space.replay(workloads, accesses_per_thread);
+
+        std::cout << "  " << num_threads << " thread(s): " << std::fixed << std::setprecision(1)
+                  << stats.get_throughput() / 1e6 << " M translations/s, faults "
+                  << space.get_page_faults() << ", lost fault races " << space.get_fault_races()
+                  << ", frames " << space.get_allocated_frames() << " for "
+                  << space.get_page_table().get_num_entries() << " pages, TLB hit rate "
+                  << *std::min_element(stats.tlb_hit_rates.begin(), stats.tlb_hit_rates.end()) * 100.0
+                  << "-"
+                  << *std::max_element(stats.tlb_hit_rates.begin(), stats.tlb_hit_rates.end()) * 100.0
+                  << "% per thread\n";
+    }
+
+    // The lock-free path checks the protection bits in the PTE word on TLB
+    // hits as well as on walks, like the single-threaded VMM.
+    SharedAddressSpace guarded(Config::default_config());
+    guarded.mmap(0, 4096, kProtRead);
+    std::unique_ptr<TLB> tlb = guarded.create_tlb(0);
+    bool read = guarded.translate(*tlb, 0, false).has_value();
+    bool write_on_hit = guarded.translate(*tlb, 0, true).has_value();
+    bool unmapped = guarded.translate(*tlb, 4096, false).has_value();
+    std::cout << "  Read-only page: read " << (read ? "allowed" : "refused") << ", write on a TLB hit "
+              << (write_on_hit ? "allowed" : "refused") << "; unmapped page "
+              << (unmapped ? "allowed" : "refused") << " (" << guarded.get_protection_faults()
+              << " protection fault, " << guarded.get_segfaults() << " segfault)\n";
+}
+
+void demo_cache_hierarchy() {
+    std::cout << "\n=== Demo 14: Cache Hierarchy and Page Colouring ===\n";
+
+    for (bool colouring : {false, true}) {
+        Config config = Config::default_config();
+        config.physical_memory_size = 16 * 1024 * 1024;
+        config.num_frames = config.physical_memory_size / config.page_size;
+        config.cache_model = true;
+        config.page_colouring = colouring;
+        config.llc_size = 1024 * 1024;
+        config.llc_associativity = 8;
+        VirtualMemoryManager vmm(config);
+
+        const size_t page_size = config.page_size;
+        const size_t scratch_pages = config.num_frames;
+        vmm.mmap(0, 64 * 1024 * 1024, kProtRead | kProtWrite, VmaBacking::Anonymous, true);
+
+        std::vector<size_t> order(scratch_pages);
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::mt19937 gen(7);
+        std::shuffle(order.begin(), order.end(), gen);
+        for (size_t page : order) {
+            vmm.allocate_page(page * page_size);
+        }
+        std::shuffle(order.begin(), order.end(), gen);
+        for (size_t page : order) {
+            vmm.free_page(page * page_size);
+        }
+
+        // Blocked sweep of an LLC-sized buffer: each L1-sized tile is re-read
+        // a few times, each L2-sized tile is revisited, and the whole buffer
+        // is reused across passes, so every level sees reuse at its own scale.
+        const VirtualAddress buffer = 32 * 1024 * 1024;
+        const size_t buffer_size = config.llc_size;
+        const size_t l1_tile = config.l1_cache_size / 2;
+        const size_t l2_tile = config.l2_cache_size / 2;
+        for (size_t pass = 0; pass < 6; ++pass) {
+            if (pass == 1) {
+                vmm.reset_statistics();
+            }
+            for (size_t l2_base = 0; l2_base < buffer_size; l2_base += l2_tile) {
+                for (size_t l2_round = 0; l2_round < 2; ++l2_round) {
+                    for (size_t l1_base = l2_base; l1_base < l2_base + l2_tile; l1_base += l1_tile) {
+                        for (size_t l1_round = 0; l1_round < 4; ++l1_round) {
+                            for (size_t offset = l1_base; offset < l1_base + l1_tile;
+                                 offset += config.cache_line_size) {
+                                vmm.access(buffer + offset, false);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        CacheHierarchy& caches = *vmm.get_caches();
+        std::cout << (colouring ? "Page colouring allocator" : "FIFO frame allocator")
+                  << " (" << vmm.get_physical_memory().get_num_colours() << " colours):\n";
+        for (size_t level = 0; level < caches.get_num_levels(); ++level) {
+            const Cache& cache = caches.get_level(level);
+            std::cout << "  " << std::left << std::setw(10) << cache.get_name() << std::right
+                      << " miss rate: " << std::fixed << std::setprecision(2)
+                      << cache.get_miss_rate() * 100.0 << "%\n";
+        }
+        std::cout << "  Cycles per access: "
+                  << static_cast<double>(vmm.get_modelled_cycles()) / vmm.get_total_accesses() << "\n";
+    }
+}
+
+void demo_trace_preprocessing() {
+    std::cout << "\n=== Demo 15: Page-Run Trace Preprocessing ===\n";
+
+    const WorkloadRegion region{0, 32 * 1024 * 1024};
+    std::vector<PhaseWorkload::Phase> phases;
+    phases.push_back({std::make_unique<SequentialWorkload>(region, 8, 0.3, 1), 1500000});
+    phases.push_back({std::make_unique<ZipfianWorkload>(region, 4096, 0.99, 0.1, 2), 500000});
+    PhaseWorkload workload(std::move(phases));
+
+    const size_t num_accesses = 2000000;
+    {
+        std::ofstream raw("vm_trace.txt");
+        std::vector<MemoryAccess> batch(4096);
+        for (size_t done = 0; done < num_accesses; done += batch.size()) {
+            size_t n = workload.generate(batch.data(), std::min(batch.size(), num_accesses - done));
+            for (size_t i = 0; i < n; ++i) {
+                raw << (batch[i].write ? "W 0x" : "R 0x") << std::hex << batch[i].address << std::dec << '\n';
+            }
+        }
+    }
+
+    std::ifstream raw_in("vm_trace.txt", std::ios::binary | std::ios::ate);
+    size_t raw_bytes = static_cast<size_t>(raw_in.tellg());
+    raw_in.seekg(0);
+    TraceConversionStats converted = convert_raw_trace(raw_in, "vm_trace.vpr", 12);
+    std::cout << "Raw trace: " << raw_bytes << " bytes, " << converted.accesses << " accesses\n";
+    std::cout << "Page-run trace: " << converted.output_bytes << " bytes, " << converted.runs
+              << " runs in " << converted.chunks << " chunks (" << std::fixed << std::setprecision(1)
+              << static_cast<double>(raw_bytes) / converted.output_bytes << "x smaller, "
+              << static_cast<double>(converted.accesses) / converted.runs << " accesses per run)\n";
+
+    // Decode both the default layout and one with deliberately small chunks,
+    // and check each against the raw trace access by access.
+    {
+        std::ifstream raw_small("vm_trace.txt", std::ios::binary);
+        convert_raw_trace(raw_small, "vm_trace_small.vpr", 12, 257);
+    }
+    for (const char* path : {"vm_trace.vpr", "vm_trace_small.vpr"}) {
+        std::ifstream raw_check("vm_trace.txt", std::ios::binary);
+        PageRunReader check_reader(path);
+        TraceVerificationStats verified = verify_page_run_trace(raw_check, check_reader);
+        std::cout << "Round trip over " << verified.chunks << " chunks: " << verified.accesses
+                  << " accesses, " << verified.mismatches << " mismatches";
+        if (!verified.matches()) {
+            std::cout << " (first at access " << verified.first_mismatch << ")";
+        }
+        std::cout << "\n";
+    }
+    std::remove("vm_trace_small.vpr");
+
+    auto make_vmm = [] {
+        auto vmm = std::make_unique<VirtualMemoryManager>(Config::default_config());
+        vmm->mmap(0, 32 * 1024 * 1024, kProtRead | kProtWrite, VmaBacking::Anonymous, true);
+        return vmm;
+    };
+
+    auto per_access = make_vmm();
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::ifstream in("vm_trace.txt", std::ios::binary);
+        RawTraceReader reader(in);
+        std::vector<MemoryAccess> batch(65536);
+        while (size_t n = reader.read(batch.data(), batch.size())) {
+            for (size_t i = 0; i < n; ++i) {
+                per_access->translate(batch[i].address, batch[i].write);
+            }
+        }
+    }
+    double raw_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto per_run = make_vmm();
+    start = std::chrono::steady_clock::now();
+    PageRunReader reader("vm_trace.vpr");
+    WorkloadRunStats stats = replay_page_runs(*per_run, reader);
+    double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Raw replay: " << std::setprecision(3) << raw_seconds << " s, page-run replay: "
+              << run_seconds << " s (" << std::setprecision(1) << raw_seconds / run_seconds
+              << "x faster)\n";
+    std::cout << "  Accesses: " << per_access->get_total_accesses() << " / " << per_run->get_total_accesses()
+              << ", TLB hits: " << per_access->get_tlb_hits() << " / " << per_run->get_tlb_hits()
+              << ", page faults: " << per_access->get_page_faults() << " / " << per_run->get_page_faults()
+              << ", failed: " << stats.failed << "\n";
+
+    std::remove("vm_trace.txt");
+}
+
+void demo_sampled_simulation() {
+    std::cout << "\n=== Demo 16: Sampled Simulation with Phase Detection ===\n";
+
+    auto make_workload = [] {
+        std::vector<PhaseWorkload::Phase> phases;
+        phases.push_back({std::make_unique<SequentialWorkload>(WorkloadRegion{0, 48 * 1024 * 1024},
+                                                               8, 0.3, 1), 1200000});
+        phases.push_back({std::make_unique<ZipfianWorkload>(WorkloadRegion{0, 48 * 1024 * 1024},
+                                                            4096, 0.99, 0.1, 2), 600000});
+        phases.push_back({std::make_unique<PointerChaseWorkload>(
+                              WorkloadRegion{16 * 1024 * 1024, 8 * 1024 * 1024}, 64, 0.0, 3), 400000});
+        phases.push_back({std::make_unique<UniformWorkload>(WorkloadRegion{40 * 1024 * 1024,
+                                                                           4 * 1024 * 1024}, 0.5, 4), 300000});
+        return std::make_unique<PhaseWorkload>(std::move(phases));
+    };
+
+    const size_t num_accesses = 10000000;
+    auto reference = make_workload();
+    VirtualMemoryManager full(Config::default_config());
+    auto start = std::chrono::steady_clock::now();
+    run_workload(full, *reference, num_accesses);
+    double full_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto workload = make_workload();
+    start = std::chrono::steady_clock::now();
+    PhaseProfile profile = profile_phases(*workload, num_accesses, 12);
+    double profile_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    VirtualMemoryManager sampled(Config::default_config());
+    start = std::chrono::steady_clock::now();
+    SampledRunStats stats = run_sampled(sampled, *workload, profile);
+    double sampled_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << profile.num_intervals << " intervals of " << profile.config.interval_length
+              << " accesses, " << profile.num_phases << " phases, " << stats.detailed_intervals
+              << " simulated in detail\n";
+    std::cout << "Detailed / warm-up / fast-forwarded accesses: " << stats.detailed_accesses << " / "
+              << stats.warmup_accesses << " / " << stats.fast_forwarded_accesses << "\n";
+
+    auto report = [](const char* name, double actual, const SampledEstimate& estimate) {
+        std::cout << "  " << std::left << std::setw(18) << name << std::right << std::fixed
+                  << std::setprecision(0) << "actual " << actual << ", estimate " << estimate.value;
+        if (!estimate.interval_known) {
+            std::cout << " +/- unknown" << std::setprecision(2) << " (error "
+                      << (estimate.value - actual) / actual * 100.0 << "%, too few samples for a CI)\n";
+            return;
+        }
+        std::cout << " +/- " << estimate.half_width << std::setprecision(2) << " (error "
+                  << (estimate.value - actual) / actual * 100.0 << "%, "
+                  << (actual >= estimate.lower() && actual <= estimate.upper() ? "inside" : "outside")
+                  << " 95% CI)\n";
+    };
+    report("Modelled cycles:", static_cast<double>(full.get_modelled_cycles()), stats.modelled_cycles);
+    report("TLB misses:", static_cast<double>(full.get_tlb_misses()), stats.tlb_misses);
+    report("Page faults:", static_cast<double>(full.get_page_faults()), stats.page_faults);
+
+    std::cout << std::setprecision(3) << "Full simulation: " << full_seconds << " s, profiling: "
+              << profile_seconds << " s, sampled run: " << sampled_seconds << " s ("
+              << std::setprecision(1) << full_seconds / (profile_seconds + sampled_seconds)
+              << "x faster end to end, " << full_seconds / sampled_seconds << "x excluding profiling, "
+              << static_cast<double>(num_accesses) / (stats.detailed_accesses + stats.warmup_accesses)
+              << "x fewer detailed accesses)\n";
+}
+
+void demo_transparent_huge_pages() {
+    std::cout << "\n=== Demo 17: Transparent Huge Page Promotion and Demotion ===\n";
+
+    auto make_config = [](size_t memory, bool thp) {
+        Config config = Config::x86_64_config();
+        config.physical_memory_size = memory;
+        config.num_frames = memory / config.page_size;
+        config.compressed_pool_size = memory / 5;
+        config.min_free_frames = config.num_frames / 128;
+        config.low_free_frames = config.min_free_frames * 5 / 4;
+        config.high_free_frames = config.min_free_frames * 3 / 2;
+        config.transparent_huge_pages = thp;
+        // Collapse only in the explicit sweeps below, so the results do not
+        // depend on when a background khugepaged pass happens to run.
+        config.thp_background_scan = false;
+        return config;
+    };
+    auto huge_mappings = [](VirtualMemoryManager& vmm, VirtualAddress start, VirtualAddress end) {
+        PageNumber span = vmm.get_page_table().get_huge_page_pages();
+        size_t count = 0;
+        for (PageNumber vpn = start / 4096; vpn < end / 4096; vpn += span) {
+            const PageTableEntry* entry = vmm.get_page_table().get_entry(vpn);
+            count += entry && entry->valid && entry->huge ? 1 : 0;
+        }
+        return count;
+    };
+
+    const size_t region = 64 * 1024 * 1024;
+    const size_t huge_ranges = 2 * region / (2 * 1024 * 1024);
+    auto populate = [&](VirtualMemoryManager& vmm) {
+        vmm.mmap(0, 2 * region, kProtRead | kProtWrite, VmaBacking::Anonymous, true);
+        for (VirtualAddress addr = 0; addr < region; addr += 4096) {
+            vmm.write_byte(addr, static_cast<uint8_t>(addr >> 12));
+        }
+        UniformWorkload scatter(WorkloadRegion{region, region}, 1.0, 7);
+        std::vector<MemoryAccess> batch(4096);
+        for (size_t i = 0; i < 16; ++i) {
+            scatter.generate(batch.data(), batch.size());
+            for (const auto& access : batch) {
+                vmm.write_byte(access.address, 1);
+            }
+        }
+    };
+
+    uint64_t misses[2] = {0, 0};
+    uint64_t cycles[2] = {0, 0};
+    for (int thp = 0; thp < 2; ++thp) {
+        VirtualMemoryManager vmm(make_config(192 * 1024 * 1024, thp == 1));
+        populate(vmm);
+        if (thp) {
+            vmm.collapse_huge_pages(huge_ranges);
+        }
+        misses[thp] = vmm.get_tlb_misses();
+        cycles[thp] = vmm.get_modelled_cycles();
+
+        ZipfianWorkload workload(WorkloadRegion{0, 2 * region}, 4096, 0.9, 0.2, 3);
+        run_workload(vmm, workload, 2000000, false);
+        misses[thp] = vmm.get_tlb_misses() - misses[thp];
+        cycles[thp] = vmm.get_modelled_cycles() - cycles[thp];
+
+        if (thp) {
+            size_t promotions = vmm.get_huge_promotions();
+            size_t attempts = promotions + vmm.get_huge_collapse_failures();
+            std::cout << "Promoted " << vmm.get_huge_mappings() << " of " << huge_ranges
+                      << " 2 MB ranges (" << vmm.get_huge_promotions_in_place() << " in place, "
+                      << promotions - vmm.get_huge_promotions_in_place() << " by copying; success rate "
+                      << std::fixed << std::setprecision(1)
+                      << (attempts > 0 ? 100.0 * promotions / attempts : 0.0) << "%)\n";
+            std::cout << "Copied " << vmm.get_huge_pages_copied() << " pages for "
+                      << vmm.get_huge_collapse_cycles() << " modelled cycles; huge TLB hits: "
+                      << vmm.get_tlb_huge_hits() << "\n";
+        }
+    }
+    std::cout << "TLB misses (4K only / THP): " << misses[0] << " / " << misses[1] << " ("
+              << std::setprecision(1) << 100.0 * (1.0 - static_cast<double>(misses[1]) / misses[0])
+              << "% fewer)\n";
+    std::cout << "Modelled cycles (4K only / THP): " << cycles[0] << " / " << cycles[1] << "\n";
+
+    // Shrink memory below the working set: cold huge pages are split so
+    // their base pages can be reclaimed individually.
+    VirtualMemoryManager tight(make_config(96 * 1024 * 1024, true));
+    tight.mmap(0, region, kProtRead | kProtWrite, VmaBacking::Anonymous, true);
+    for (VirtualAddress addr = 0; addr < region; addr += 4096) {
+        tight.write_byte(addr, static_cast<uint8_t>(addr >> 12));
+    }
+    tight.collapse_huge_pages(huge_ranges);
+    size_t before = huge_mappings(tight, 0, region);
+
+    // Touching a second region evicts from the first; promotion is off until
+    // the next sweep, so every change in the first region is a demotion.
+    tight.mmap(2 * region, region, kProtRead | kProtWrite, VmaBacking::Anonymous, true);
+    for (VirtualAddress addr = 2 * region; addr < 3 * region; addr += 4096) {
+        tight.write_byte(addr, 1);
+    }
+    size_t pressured = huge_mappings(tight, 0, region);
+    size_t failures = tight.get_huge_collapse_failures();
+    tight.collapse_huge_pages(huge_ranges);
+    size_t after_first = huge_mappings(tight, 0, region);
+    size_t after_second = huge_mappings(tight, 2 * region, 3 * region);
+
+    std::cout << "Under pressure, first region: " << before << " huge mappings, "
+              << before - pressured << " demoted, " << after_first - pressured
+              << " re-promoted, " << after_first << " left\n";
+    std::cout << "Under pressure, second region: " << after_second << " of " << huge_ranges / 2
+              << " promoted, " << tight.get_huge_collapse_failures() - failures
+              << " collapses refused below the watermark\n";
+}
+
+void demo_metrics_export(VirtualMemoryManager& vmm) {
+    std::cout << "\n=== Demo 18: Metrics Export ===\n";
+
+    MetricsExporter exporter(vmm.get_metrics(), "vm_metrics.prom");
+    if (exporter.write_now()) {
+        std::cout << "Wrote Prometheus metrics to vm_metrics.prom\n";
+    }
+
+    // A second simulator keeps faulting pages in while a background exporter
+    // rewrites its JSON snapshot every 10 ms; stop() writes a final one.
+    VirtualMemoryManager live(Config::default_config());
+    live.mmap(0, 256 * 1024 * 1024, kProtRead | kProtWrite, VmaBacking::Anonymous, true);
+    MetricsExporter periodic(live.get_metrics(), "vm_metrics.json", MetricsExporter::Format::Json,
+                             std::chrono::milliseconds(10));
+    periodic.start();
+    for (VirtualAddress addr = 0; addr < 256 * 1024 * 1024; addr += 4096) {
+        live.read_byte(addr);
+    }
+    periodic.stop();
+    std::ifstream snapshot("vm_metrics.json");
+    std::string json((std::istreambuf_iterator<char>(snapshot)), std::istreambuf_iterator<char>());
+    std::cout << "Periodic JSON export: " << periodic.get_exports() << " snapshots while faulting in "
+              << live.get_page_faults() << " pages, final one "
+              << (json.find("\"page_faults\": " + std::to_string(live.get_page_faults())) != std::string::npos
+                      ? "current" : "stale")
+              << "\n";
+
+    std::cout << "\nMetrics snapshot (JSON):\n";
+    vmm.get_metrics().write_json(std::cout);
+    std::cout << "Registry footprint: " << vmm.get_metrics().get_slots_used() << " slots registered, "
+              << vmm.get_metrics().get_bytes_allocated() / 1024 << " KB of counter pages across "
+              << vmm.get_metrics().get_num_threads() << " thread(s)\n";
+}
+
 int main() {
     std::cout << "========================================\n";
     std::cout << "   Virtual Memory Manager Simulator\n";
@@ -191,6 +903,12 @@ int main() {
     std::cout << "  TLB size: " << config.tlb_size << " entries\n";
     std::cout << "  Page table levels: " << config.page_table_levels << "\n";
 
+    const size_t heap_size = 512 * 1024 * 1024;
+    if (!vmm.mmap(0, heap_size, kProtRead | kProtWrite, VmaBacking::Anonymous, true)) {
+        std::cerr << "Error: failed to map demo heap" << std::endl;
+        return 1;
+    }
+
     try {
         demo_basic_operations(vmm);
         demo_tlb_behavior(vmm);
@@ -198,6 +916,18 @@ int main() {
         demo_page_table_hierarchy(vmm);
         demo_random_access(vmm);
         demo_access_patterns(vmm);
+        demo_workload_generators();
+        demo_address_space_regions(vmm);
+        demo_tlb_shootdowns();
+        demo_compressed_tier();
+        demo_background_reclaim();
+        demo_nested_paging();
+        demo_shared_address_space();
+        demo_cache_hierarchy();
+        demo_trace_preprocessing();
+        demo_sampled_simulation();
+        demo_transparent_huge_pages();
+        demo_metrics_export(vmm);
 
         vmm.print_statistics();
 
@@ -213,6 +943,18 @@ int main() {
     std::cout << "  - Demand paging\n";
     std::cout << "  - Configurable page sizes and memory hierarchies\n";
     std::cout << "  - Various memory access patterns\n";
+    std::cout << "  - Deterministic synthetic workload generators\n";
+    std::cout << "  - mmap/munmap/mprotect over a VMA tree\n";
+    std::cout << "  - ASID-tagged TLBs with batched shootdowns\n";
+    std::cout << "  - Compressed RAM tier with LZ4-style compression\n";
+    std::cout << "  - Watermark-driven background reclaim daemon\n";
+    std::cout << "  - Nested 2D paging with walk caches\n";
+    std::cout << "  - Lock-free concurrent translation in a shared address space\n";
+    std::cout << "  - Physically-indexed cache hierarchy with page colouring\n";
+    std::cout << "  - Compressed page-run trace format with run-length replay\n";
+    std::cout << "  - SimPoint-style sampled simulation with confidence intervals\n";
+    std::cout << "  - Transparent huge page promotion and demotion\n";
+    std::cout << "  - Unified metrics registry with Prometheus/JSON export\n";
 
     return 0;
 }
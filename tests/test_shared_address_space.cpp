@@ -0,0 +1,132 @@
+#include "SharedAddressSpace.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace vm;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond "\n"; \
+            failures++;                                                            \
+        }                                                                          \
+    } while (0)
+
+// A fault that finds the PTE claimed by another thread must wait for that
+// thread to publish and then use its frame, not install a second one.
+void test_fault_waits_for_claimed_entry() {
+    Config config = Config::default_config();
+    SharedAddressSpace space(config);
+    CHECK(space.mmap(0, 16 * config.page_size, kProtRead | kProtWrite));
+
+    const PageNumber vpn = 5;
+    PageTableEntry existing;
+    CHECK(space.get_page_table().claim(vpn, existing) == ClaimResult::Claimed);
+
+    std::optional<PhysicalAddress> seen;
+    std::thread faulting([&] {
+        std::unique_ptr<TLB> tlb = space.create_tlb(1);
+        seen = space.translate(*tlb, vpn * config.page_size + 8, true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    space.get_page_table().publish(vpn, 42, kProtRead | kProtWrite);
+    faulting.join();
+
+    CHECK(seen.has_value() && seen.value() == 42 * config.page_size + 8);
+    CHECK(space.get_fault_races() == 1);
+    CHECK(space.get_page_faults() == 0);
+    CHECK(space.get_allocated_frames() == 0);
+    CHECK(space.get_page_table().lookup(vpn)->dirty);
+}
+
+// Threads faulting the same pages in the same order must agree on one frame
+// per page, and every page must be installed exactly once.
+void test_racing_faults_install_one_mapping() {
+    Config config = Config::default_config();
+    SharedAddressSpace space(config);
+    const size_t num_pages = 1024;
+    const size_t num_threads = 8;
+    CHECK(space.mmap(0, num_pages * config.page_size, kProtRead | kProtWrite));
+
+    std::vector<std::vector<FrameNumber>> frames(num_threads, std::vector<FrameNumber>(num_pages));
+    std::atomic<size_t> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            std::unique_ptr<TLB> tlb = space.create_tlb(t);
+            ready.fetch_add(1);
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            for (PageNumber vpn = 0; vpn < num_pages; ++vpn) {
+                auto paddr = space.translate(*tlb, vpn * config.page_size, t % 2 == 0);
+                frames[t][vpn] = paddr.has_value() ? paddr.value() / config.page_size : ~0ULL;
+                if (vpn % 16 == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    while (ready.load() < num_threads) {
+        std::this_thread::yield();
+    }
+    go.store(true);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::set<FrameNumber> distinct;
+    for (PageNumber vpn = 0; vpn < num_pages; ++vpn) {
+        for (size_t t = 1; t < num_threads; ++t) {
+            CHECK(frames[t][vpn] == frames[0][vpn]);
+        }
+        distinct.insert(frames[0][vpn]);
+    }
+    CHECK(distinct.size() == num_pages);
+    CHECK(space.get_page_faults() == num_pages);
+    CHECK(space.get_allocated_frames() == num_pages);
+    CHECK(space.get_page_table().get_num_entries() == num_pages);
+}
+
+// Protection bits in the PTE word are enforced on TLB hits and walks alike.
+void test_protection_checked_on_every_path() {
+    Config config = Config::default_config();
+    SharedAddressSpace space(config);
+    CHECK(space.mmap(0, config.page_size, kProtRead));
+
+    std::unique_ptr<TLB> first = space.create_tlb(0);
+    CHECK(!space.translate(*first, 0, true).has_value());
+    CHECK(space.translate(*first, 0, false).has_value());
+    CHECK(!space.translate(*first, 0, true).has_value());
+
+    std::unique_ptr<TLB> second = space.create_tlb(1);
+    CHECK(!space.translate(*second, 0, true).has_value());
+    CHECK(!space.get_page_table().lookup(0)->dirty);
+    CHECK(space.get_protection_faults() == 3);
+
+    CHECK(!space.translate(*second, config.page_size, false).has_value());
+    CHECK(space.get_segfaults() == 1);
+}
+
+} // namespace
+
+int main() {
+    test_fault_waits_for_claimed_entry();
+    test_racing_faults_install_one_mapping();
+    test_protection_checked_on_every_path();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << "All shared address space tests passed\n";
+    return 0;
+}
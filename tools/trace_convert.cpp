@@ -0,0 +1,94 @@
+#include "PageRunTrace.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace vm;
+
+namespace {
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <raw-trace|-> <output.vpr> [page-bits]\n"
+              << "       " << program << " --info <trace.vpr>\n"
+              << "       " << program << " --verify <raw-trace> <trace.vpr>\n\n"
+              << "Raw traces hold one access per line: an operation (R/L/I for reads,\n"
+              << "W/S/M for writes) followed by a hexadecimal address.\n";
+}
+
+int print_info(const std::string& path) {
+    PageRunReader reader(path);
+    std::cout << "Page size: " << (1ULL << reader.get_page_shift()) << " bytes\n";
+    std::cout << "Accesses: " << reader.get_total_accesses() << "\n";
+    std::cout << "Runs: " << reader.get_total_runs() << "\n";
+    std::cout << "Chunks: " << reader.get_num_chunks() << "\n";
+    for (size_t i = 0; i < reader.get_num_chunks(); ++i) {
+        const PageRunChunkInfo& info = reader.get_chunk_info(i);
+        std::cout << "  [" << i << "] offset " << info.offset << ", " << info.bytes << " bytes, "
+                  << info.runs << " runs, " << info.accesses << " accesses, first vpn 0x"
+                  << std::hex << info.first_vpn << std::dec << "\n";
+    }
+    return 0;
+}
+
+int verify(const std::string& raw_path, const std::string& trace_path) {
+    std::ifstream raw(raw_path, std::ios::binary);
+    if (!raw) {
+        std::cerr << "Error: cannot open " << raw_path << std::endl;
+        return 1;
+    }
+    PageRunReader reader(trace_path);
+    TraceVerificationStats stats = verify_page_run_trace(raw, reader);
+    std::cout << "Checked " << stats.accesses << " accesses in " << stats.chunks << " chunks: ";
+    if (stats.matches()) {
+        std::cout << "trace matches\n";
+        return 0;
+    }
+    std::cout << stats.mismatches << " mismatches, first at access " << stats.first_mismatch << "\n";
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        if (argc == 3 && std::string(argv[1]) == "--info") {
+            return print_info(argv[2]);
+        }
+        if (argc == 4 && std::string(argv[1]) == "--verify") {
+            return verify(argv[2], argv[3]);
+        }
+        if (argc < 3 || argc > 4) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        size_t page_bits = argc == 4 ? std::stoul(argv[3]) : 12;
+        std::string input = argv[1];
+        std::ifstream file;
+        if (input != "-") {
+            file.open(input, std::ios::binary);
+            if (!file) {
+                std::cerr << "Error: cannot open " << input << std::endl;
+                return 1;
+            }
+        }
+
+        TraceConversionStats stats =
+            convert_raw_trace(input == "-" ? std::cin : file, argv[2], page_bits);
+
+        std::cout << "Accesses: " << stats.accesses << "\n";
+        std::cout << "Page runs: " << stats.runs << " in " << stats.chunks << " chunks\n";
+        std::cout << "Output: " << stats.output_bytes << " bytes ("
+                  << std::fixed << std::setprecision(3)
+                  << (stats.accesses > 0 ? static_cast<double>(stats.output_bytes) / stats.accesses : 0.0)
+                  << " bytes/access)\n";
+        if (stats.skipped_lines > 0) {
+            std::cout << "Skipped lines: " << stats.skipped_lines << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}